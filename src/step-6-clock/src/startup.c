@@ -1,4 +1,5 @@
 #include "derivative.h"
+#include <stdbool.h>
 #include <string.h>
 
 extern int main(void);  // Defined in main.c
@@ -127,6 +128,66 @@ static void inter_clock(void) {
 
 static void exter_clock(void) { MCGOUTClock = CPU_XTAL_CLK_HZ; }
 
+#define MCG_TIMEOUT 100000U  // Polls of an MCG status flag before giving up
+
+// Wait until (MCG->S & mask) == value, return false on timeout
+static bool mcg_wait(uint8_t mask, uint8_t value) {
+    for (uint32_t i = 0; i < MCG_TIMEOUT; i++)
+        if ((MCG->S & mask) == value) return true;
+    return false;
+}
+
+/*
+    Move the MCG from FEI (reset default, 20.97 MHz FLL) to PEE:
+    8 MHz crystal / PRDIV0 2 = 4 MHz PLL reference, * VDIV0 24 = 96 MHz PLL output,
+    core = 96 MHz / OUTDIV1 2 = 48 MHz, bus and flash = 48 MHz / OUTDIV4 2 = 24 MHz.
+    Return false if a step timed out.
+*/
+static bool pee_enter(void) {
+    // EXTAL0/XTAL0 (PTA18/PTA19) on their default analog function for the crystal
+    SIM->SCGC5 |= SIM_SCGC5_PORTA_MASK;
+    PORTA->PCR[18] = PORT_PCR_MUX(0x0);
+    PORTA->PCR[19] = PORT_PCR_MUX(0x0);
+
+    // Dividers first, so no clock is ever above its limit during the switch
+    SIM->CLKDIV1 = SIM_CLKDIV1_OUTDIV1(0x1) | SIM_CLKDIV1_OUTDIV4(0x1);
+
+    /*
+        FEI -> FBE: external reference on MCGOUTCLK, FLL still running from it
+        RANGE0 = 01: high frequency crystal, EREFS0: oscillator requested
+        CLKS = 10: external reference, FRDIV = 011: 8 MHz / 256 = 31.25 kHz for the FLL, IREFS = 0
+    */
+    MCG->C2 = MCG_C2_RANGE0(0x1) | MCG_C2_EREFS0_MASK;
+    MCG->C1 = MCG_C1_CLKS(0x2) | MCG_C1_FRDIV(0x3);
+    if (!mcg_wait(MCG_S_OSCINIT0_MASK, MCG_S_OSCINIT0_MASK)) return false;
+    if (!mcg_wait(MCG_S_IREFST_MASK, 0)) return false;
+    if (!mcg_wait(MCG_S_CLKST_MASK, MCG_S_CLKST(0x2))) return false;
+
+    // FBE -> PBE: PLL selected and locked while MCGOUTCLK still comes from the crystal
+    MCG->C5 = MCG_C5_PRDIV0(0x1);
+    MCG->C6 = MCG_C6_PLLS_MASK | MCG_C6_VDIV0(0x0);
+    if (!mcg_wait(MCG_S_PLLST_MASK, MCG_S_PLLST_MASK)) return false;
+    if (!mcg_wait(MCG_S_LOCK0_MASK, MCG_S_LOCK0_MASK)) return false;
+
+    // PBE -> PEE: PLL on MCGOUTCLK
+    MCG->C1 &= (uint8_t)~MCG_C1_CLKS_MASK;
+    return mcg_wait(MCG_S_CLKST_MASK, MCG_S_CLKST(0x3));
+}
+
+// Run from the PLL, or go back to FEI and the default clocks if the crystal or the PLL fails
+static void pll_init(void) {
+    if (pee_enter()) {
+        // MCGPLLCLK / 2 = 48 MHz for the peripherals with a selectable clock (TPM, UART0, USB)
+        SIM->SOPT2 |= SIM_SOPT2_PLLFLLSEL_MASK;
+        return;
+    }
+    MCG->C6 = 0;
+    MCG->C1 = MCG_C1_IREFS_MASK;  // FEI: FLL on the slow internal reference
+    MCG->C2 = 0;
+    mcg_wait(MCG_S_CLKST_MASK | MCG_S_IREFST_MASK, MCG_S_IREFST_MASK);
+    SIM->CLKDIV1 = SIM_CLKDIV1_OUTDIV1(0x0) | SIM_CLKDIV1_OUTDIV4(0x1);
+}
+
 static void clock_init(void) {
     /*
         CLKS: Clock Source Select, bits 6-7 of MCG_C1
@@ -164,6 +225,7 @@ __attribute__((naked, noreturn)) void _reset(void) {
     __init_hardware();
     zero_fill_bss();
     copy_data();
+    pll_init();
     clock_init();
 
     main();
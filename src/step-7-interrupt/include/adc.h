@@ -0,0 +1,38 @@
+#pragma once
+
+#include "derivative.h"
+#include "dma.h"
+#include "work.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef ADC_BLOCK_SAMPLES
+#define ADC_BLOCK_SAMPLES 128  // Samples per ping-pong buffer
+#endif
+_Static_assert(ADC_BLOCK_SAMPLES * 2 <= DMA_DSR_BCR_BCR_MASK, "ADC block does not fit the 20-bit DMA byte count");
+
+// Called as deferred work with a filled buffer, which is reused once this returns
+typedef void (*adc_block_t)(const uint16_t *samples, size_t count, void *arg);
+
+typedef struct {
+    volatile uint32_t blocks;   // Buffers handed to the callback
+    volatile uint32_t dropped;  // Buffers overwritten because the callback had not finished the other one
+    volatile uint32_t errors;   // DMA transfers stopped on a bus or configuration error
+} adc_stats_t;
+
+extern adc_stats_t adc_stats;  // Defined in src/adc.c
+
+extern bool adc_init(void);  // Defined in src/adc.c
+extern void adc_start(uint8_t channel, uint32_t rate_hz, adc_block_t done, void *arg);
+extern void adc_stop(void);
+extern void adc_irq(void);
+
+/*
+    Continuous sampling of one ADC0 single-ended channel (ADC0_SEn, e.g. 8 for PTB0)
+    at rate_hz, 16-bit results. PIT channel 0 triggers each conversion in hardware,
+    the conversion raises a DMA request and DMA_CH_ADC0 moves the result into one of
+    two SRAM_U buffers, so the CPU sees one interrupt per ADC_BLOCK_SAMPLES samples.
+    adc_irq switches the DMA to the other buffer and posts the full one to the callback.
+    If the callback still holds that other buffer, the block just taken is dropped
+    and its buffer filled again.
+*/
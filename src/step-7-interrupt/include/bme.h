@@ -0,0 +1,31 @@
+#pragma once
+
+#include "derivative.h"
+
+/*
+    Bit Manipulation Engine: a store to a decorated alias of a peripheral register
+    makes the BME read the register, apply the operation and write it back as one
+    bus transaction. Nothing can come in between, so an ISR updating other bits of
+    the same register never loses its update, and no interrupt masking is needed.
+    Only peripherals at 0x40000000-0x4007FFFF (SIM, PORT, UART, DMA, MCG, LPTMR, ...)
+    are decorated, not GPIO/FGPIO, SRAM or the Cortex-M0+ registers (SCB, SysTick, NVIC).
+    The access width is the register's: UART C2 stays a byte store.
+
+    BME_AND(reg, mask)             reg &= mask
+    BME_OR(reg, mask)              reg |= mask
+    BME_XOR(reg, mask)             reg ^= mask
+    BME_BFI(reg, bit, width, v)    reg[bit + width - 1:bit] = v[bit + width - 1:bit], v already shifted
+    BME_UBFX(reg, bit, width)      reg[bit + width - 1:bit] >> bit, as a load
+*/
+#define BME_OP_AND 0x04000000u
+#define BME_OP_OR 0x08000000u
+#define BME_OP_XOR 0x0C000000u
+#define BME_OP_BF(bit, width) (0x10000000u | (uint32_t)(bit) << 23 | (uint32_t)((width) - 1) << 19)
+
+#define BME_REG(reg, op) (*(__typeof__(reg) *)((uintptr_t)&(reg) | (op)))
+
+#define BME_AND(reg, mask) (BME_REG(reg, BME_OP_AND) = (__typeof__(reg))(mask))
+#define BME_OR(reg, mask) (BME_REG(reg, BME_OP_OR) = (__typeof__(reg))(mask))
+#define BME_XOR(reg, mask) (BME_REG(reg, BME_OP_XOR) = (__typeof__(reg))(mask))
+#define BME_BFI(reg, bit, width, v) (BME_REG(reg, BME_OP_BF(bit, width)) = (__typeof__(reg))(v))
+#define BME_UBFX(reg, bit, width) (BME_REG(reg, BME_OP_BF(bit, width)))
@@ -3,20 +3,76 @@
 #include "MKL25Z4.h"
 
 // Define Clock Settings
-#define CORCLK_DEFAULT 20970000u  // Default Core clock, 20.97 Mhz
-#define BUSCLK_DEFAULT 10500000u  // Default Bus Rate clock, 10.5 Mhz, half of CORCLK
+#define CORCLK_DEFAULT 20970000u  // FEI Core clock, 20.97 Mhz, only if the PLL fails to start
+#define BUSCLK_DEFAULT 10500000u  // FEI Bus Rate clock, 10.5 Mhz, half of CORCLK_DEFAULT
 
 #define CPU_XTAL_CLK_HZ 8000000u      // Value of the external crystal or oscillator clock frequency in Hz
 #define CPU_INT_SLOW_CLK_HZ 32768u    // Value of the slow internal oscillator clock frequency in Hz
 #define CPU_INT_FAST_CLK_HZ 4000000u  // Value of the fast internal oscillator clock frequency in Hz
 
+/*
+    Clock tree, set up by pll_init in startup.c and fixed at compile time:
+    crystal / PRDIV0 -> PLL reference * VDIV0 -> PLL output / OUTDIV1 -> core / OUTDIV4 -> bus and flash.
+    Everything derived from it (UART SBR, SysTick reload) is folded by the compiler.
+    Build with -DCLOCK_VERIFY to decode the MCG registers at boot and compare.
+*/
+#define CLOCK_PRDIV 2    // 8 MHz / 2 = 4 MHz PLL reference
+#define CLOCK_VDIV 24    // 4 MHz * 24 = 96 MHz PLL output
+#define CLOCK_OUTDIV1 2  // 96 MHz / 2 = 48 MHz core
+#define CLOCK_OUTDIV4 2  // 48 MHz / 2 = 24 MHz bus and flash
+#define CLOCK_FRDIV 3    // FLL reference in FBE: 8 MHz / (32 << 3) = 31.25 kHz
+
+#define PLLREF (CPU_XTAL_CLK_HZ / CLOCK_PRDIV)
+#define PLLCLK (PLLREF * CLOCK_VDIV)
+#define CORCLK ((uint32_t)(PLLCLK / CLOCK_OUTDIV1))  // Core clock, 48 MHz
+#define BUSCLK ((uint32_t)(CORCLK / CLOCK_OUTDIV4))  // Bus Rate clock, 24 MHz
+
+_Static_assert(CLOCK_PRDIV >= 1 && CLOCK_PRDIV <= 25, "PRDIV0 divides by 1 to 25");
+_Static_assert(CLOCK_VDIV >= 24 && CLOCK_VDIV <= 55, "VDIV0 multiplies by 24 to 55");
+_Static_assert(CLOCK_OUTDIV1 >= 1 && CLOCK_OUTDIV1 <= 16, "OUTDIV1 divides by 1 to 16");
+_Static_assert(CLOCK_OUTDIV4 >= 1 && CLOCK_OUTDIV4 <= 8, "OUTDIV4 divides by 1 to 8");
+_Static_assert(CPU_XTAL_CLK_HZ % CLOCK_PRDIV == 0, "PLL reference is not a whole number of Hz");
+_Static_assert(PLLREF >= 2000000u && PLLREF <= 4000000u, "PLL reference must be 2 to 4 MHz");
+_Static_assert(PLLCLK >= 48000000u && PLLCLK <= 100000000u, "PLL output must be 48 to 100 MHz");
+_Static_assert(CPU_XTAL_CLK_HZ / (32u << CLOCK_FRDIV) >= 31250u &&
+                   CPU_XTAL_CLK_HZ / (32u << CLOCK_FRDIV) <= 39062u,
+               "FLL reference must be 31.25 to 39.0625 kHz");
+_Static_assert(CORCLK <= 48000000u, "Core clock above 48 MHz");
+_Static_assert(BUSCLK <= 24000000u, "Bus and flash clock above 24 MHz");
+_Static_assert(CORCLK % 1000u == 0, "SysTick needs a whole number of cycles per millisecond");
+
 #define UART_MSG UART1
 
 #define PI 3.1415926
 #define BIT(x) (1UL << (x))
 
-extern uint32_t CORCLK;
-extern uint32_t BUSCLK;
+/*
+    Run a function from SRAM instead of flash, which needs wait states above 24 MHz.
+    _reset copies .ramfunc with .data, calls between flash and SRAM go through linker veneers.
+*/
+#define RAMFUNC __attribute__((section(".ramfunc"), noinline))
+
+/*
+    Pick the sRAM array of a zero-initialized variable, see link.ld. Nothing may cross 0x20000000.
+    SRAM_L (4 KB below it) for stacks and data the core hits all the time,
+    SRAM_U (12 KB above it, with .data and .bss) for DMA buffers, away from the core's traffic.
+*/
+#define SRAM_L __attribute__((section(".bss.sram_l")))
+#define SRAM_U __attribute__((section(".bss.sram_u")))
+
+#ifdef CLOCK_VERIFY
+extern uint32_t clock_decoded_core;  // CORCLK and BUSCLK as read back from the MCG at boot
+extern uint32_t clock_decoded_bus;
+#endif
 extern volatile uint32_t ms_ticks;
+extern volatile uint32_t ms_ticks_hi;
+extern uint32_t boot_cycles;
 extern void SysTick_Handler(void);
+extern void PendSV_Handler(void);
+extern void DMA0_IRQHandler(void);
+extern void DMA1_IRQHandler(void);
+extern void DMA2_IRQHandler(void);
+extern void DMA3_IRQHandler(void);
 extern void UART1_IRQHandler(void);
+extern void UART2_IRQHandler(void);
+extern void LPTMR0_IRQHandler(void);
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "bme.h"
+#include "derivative.h"
+#include "work.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DMA_CHANNELS 4
+
+// Channel assignment, one owner per channel
+#define DMA_CH_UART1_TX 0
+#define DMA_CH_UART2_TX 1
+#define DMA_CH_ADC0 2  // Claimed by adc_start, serviced by adc_irq, not dma_irq
+#define DMA_CH_WAVE 3  // Claimed by wave_start, serviced by wave_irq, not dma_irq
+
+// DMAMUX request sources, see KL25 Sub-Family Reference Manual, Table 3-20
+#define DMA_SRC_UART0_RX 2
+#define DMA_SRC_UART0_TX 3
+#define DMA_SRC_UART1_RX 4
+#define DMA_SRC_UART1_TX 5
+#define DMA_SRC_UART2_RX 6
+#define DMA_SRC_UART2_TX 7
+#define DMA_SRC_ADC0 40
+#define DMA_SRC_TPM0_OVF 54
+#define DMA_SRC_TPM1_OVF 55
+#define DMA_SRC_TPM2_OVF 56
+#define DMA_SRC_ALWAYS 60
+
+/*
+    SSIZE/DSIZE: Source/Destination Size, bits 20-21/17-18 of DMA_DCRn
+    00: 32-bit, 01: 8-bit, 10: 16-bit
+*/
+#define DMA_SIZE_32 0U
+#define DMA_SIZE_8 1U
+#define DMA_SIZE_16 2U
+
+// Called from DMAx_IRQHandler when the transfer is done or stopped on an error
+typedef void (*dma_callback_t)(uint8_t ch, bool error, void *arg);
+
+typedef struct {
+    dma_callback_t callback;
+    void *arg;
+    volatile bool active;  // Started and its callback not run yet
+    bool error;            // Status of the completed transfer, for the callback
+    work_t work;           // Runs the callback after DMAx_IRQHandler returned
+} dma_chan_t;
+
+extern dma_chan_t dma_chan[DMA_CHANNELS];  // Defined in src/dma.c
+
+static inline bool dma_busy(uint8_t ch) { return dma_chan[ch].active; }
+
+/*
+    Take channel ch: clock DMAMUX and DMA, disconnect its request and mark it busy
+    until dma_stop or its callback. A driver with its own DMAx_IRQHandler (DMA_CH_ADC0,
+    DMA_CH_WAVE) claims the channel for as long as it streams, so idle sees it busy.
+*/
+static inline void dma_claim(uint8_t ch) {
+    BME_OR(SIM->SCGC6, SIM_SCGC6_DMAMUX_MASK);
+    BME_OR(SIM->SCGC7, SIM_SCGC7_DMA_MASK);
+    DMAMUX0->CHCFG[ch] = 0;                         // Disconnect the request while reprogramming
+    DMA0->DMA[ch].DSR_BCR = DMA_DSR_BCR_DONE_MASK;  // Clear DONE and the error flags
+    dma_chan[ch].active = true;
+}
+
+/*
+    Load one transfer into channel ch, also to re-arm it from its interrupt.
+    sar/dar: source/destination address, bcr: number of bytes to move,
+    dcr: value for DMA_DCRn, usually ERQ | CS | D_REQ plus the increment and size bits.
+*/
+static inline void dma_arm(uint8_t ch, const volatile void *sar, volatile void *dar, uint32_t bcr, uint32_t dcr) {
+    DMA0->DMA[ch].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+    DMA0->DMA[ch].SAR = (uint32_t)(uintptr_t)sar;
+    DMA0->DMA[ch].DAR = (uint32_t)(uintptr_t)dar;
+    DMA0->DMA[ch].DSR_BCR = DMA_DSR_BCR_BCR(bcr);
+    DMA0->DMA[ch].DCR = dcr | DMA_DCR_EINT_MASK;  // Always interrupt on completion
+}
+
+// Route request source to channel ch, transfers start with the next request
+static inline void dma_connect(uint8_t ch, uint8_t source) {
+    NVIC_EnableIRQ((IRQn_Type)(DMA0_IRQn + ch));
+    DMAMUX0->CHCFG[ch] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(source);
+}
+
+// Program channel ch for one transfer and connect it to a request source, callback runs when done
+static inline void dma_start(uint8_t ch, uint8_t source, const volatile void *sar, volatile void *dar, uint32_t bcr,
+                             uint32_t dcr, dma_callback_t callback, void *arg) {
+    dma_claim(ch);
+    dma_chan[ch].callback = callback;
+    dma_chan[ch].arg = arg;
+    dma_arm(ch, sar, dar, bcr, dcr);
+    dma_connect(ch, source);
+}
+
+// Stop channel ch without calling its callback
+static inline void dma_stop(uint8_t ch) {
+    DMAMUX0->CHCFG[ch] = 0;
+    BME_AND(DMA0->DMA[ch].DCR, ~DMA_DCR_ERQ_MASK);
+    DMA0->DMA[ch].DSR_BCR = DMA_DSR_BCR_DONE_MASK;
+    dma_chan[ch].active = false;
+}
+
+// Called from DMAx_IRQHandler: acknowledge the channel, its callback runs as deferred work
+static inline void dma_irq(uint8_t ch) {
+    uint32_t dsr = DMA0->DMA[ch].DSR_BCR;
+    DMA0->DMA[ch].DSR_BCR = DMA_DSR_BCR_DONE_MASK;  // Writing DONE also clears CE, BES and BED
+    dma_chan[ch].error = (dsr & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK | DMA_DSR_BCR_BED_MASK)) != 0;
+    work_post(&dma_chan[ch].work);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+
+// Character sink of the formatter, called once per produced character
+typedef void (*fmt_putc_t)(char c, void *arg);
+
+/*
+    Streaming printf: every character goes to putc as soon as it is produced,
+    nothing is rendered into an intermediate buffer, so there is no length limit.
+    Supports the flags "-+ #0", width and precision (also '*'), the length
+    modifiers hh, h, l, ll, j, z, t and the conversions d i u o x X c s p %.
+    Floating point conversions consume their argument and print nothing, like newlib-nano.
+    Return the number of characters produced.
+*/
+size_t fmt_vprintf(fmt_putc_t putc, void *arg, const char *format, va_list args);
+
+__attribute__((format(printf, 3, 4))) static inline size_t fmt_printf(fmt_putc_t putc, void *arg, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    size_t cnt = fmt_vprintf(putc, arg, format, args);
+    va_end(args);
+    return cnt;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "bme.h"
+#include "derivative.h"
+#include <stdbool.h>
+
+/*
+    Pin as one number: port (A = 0 ... E = 4) times 32 plus pin, e.g. GPIO_PIN(GPIO_B, 19).
+    With a constant pin every function below folds to one store on the FGPIO alias of
+    the port, which sits on the Cortex-M0+ single-cycle IOPORT instead of the peripheral
+    bridge. Outputs change through PSOR/PCOR/PTOR, so no read-modify-write is involved
+    and an ISR driving another pin of the same port never loses an update.
+    DMA cannot reach the IOPORT, it must use the GPIOx registers.
+*/
+enum { GPIO_A, GPIO_B, GPIO_C, GPIO_D, GPIO_E };
+
+#define GPIO_PIN(port, n) ((uint8_t)((port) << 5 | (n)))
+
+static inline FGPIO_Type *gpio_fast(uint8_t pin) {
+    return (FGPIO_Type *)(FGPIOA_BASE + (uint32_t)(pin >> 5) * (FGPIOB_BASE - FGPIOA_BASE));
+}
+
+static inline PORT_Type *gpio_port(uint8_t pin) {
+    return (PORT_Type *)(PORTA_BASE + (uint32_t)(pin >> 5) * (PORTB_BASE - PORTA_BASE));
+}
+
+static inline uint32_t gpio_mask(uint8_t pin) { return BIT(pin & 31); }
+
+// Clock the port and give the pin to GPIO, pcr adds pull (PORT_PCR_PE_MASK | PORT_PCR_PS_MASK) or IRQC bits
+static inline void gpio_mux(uint8_t pin, uint32_t pcr) {
+    BME_OR(SIM->SCGC5, SIM_SCGC5_PORTA_MASK << (pin >> 5));
+    gpio_port(pin)->PCR[pin & 31] = PORT_PCR_MUX(0x1) | pcr;
+}
+
+static inline void gpio_set(uint8_t pin) { gpio_fast(pin)->PSOR = gpio_mask(pin); }
+
+static inline void gpio_clear(uint8_t pin) { gpio_fast(pin)->PCOR = gpio_mask(pin); }
+
+static inline void gpio_toggle(uint8_t pin) { gpio_fast(pin)->PTOR = gpio_mask(pin); }
+
+static inline void gpio_write(uint8_t pin, bool level) {
+    if (level)
+        gpio_set(pin);
+    else
+        gpio_clear(pin);
+}
+
+static inline bool gpio_read(uint8_t pin) { return (gpio_fast(pin)->PDIR & gpio_mask(pin)) != 0; }
+
+// Output starting at level, set before the pin is driven so it never glitches
+static inline void gpio_output(uint8_t pin, bool level) {
+    gpio_mux(pin, 0);
+    gpio_write(pin, level);
+    gpio_fast(pin)->PDDR |= gpio_mask(pin);  // No set/clear register for the direction, init only
+}
+
+static inline void gpio_input(uint8_t pin, uint32_t pcr) {
+    gpio_mux(pin, pcr);
+    gpio_fast(pin)->PDDR &= ~gpio_mask(pin);
+}
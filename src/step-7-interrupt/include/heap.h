@@ -0,0 +1,12 @@
+#pragma once
+
+#include "derivative.h"
+
+typedef struct {
+    uint32_t current;   // Bytes handed to malloc by _sbrk and not given back
+    uint32_t peak;      // Largest current so far
+    uint32_t size;      // Bytes between _end and _heap_limit, see link.ld
+    uint32_t failures;  // _sbrk calls refused with ENOMEM
+} heap_stats_t;
+
+extern heap_stats_t heap_stats;  // Defined in src/syscalls.c
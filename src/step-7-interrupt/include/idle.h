@@ -0,0 +1,19 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+
+#define IDLE_MAX_MS 65535U  // LPTMR0 compare register is 16 bits wide
+#define IDLE_PHASE_MIN 16U  // Fewest SysTick cycles left for idle to carry the phase over a sleep
+
+typedef struct {
+    volatile uint32_t sleep_ms;   // Time spent with SysTick stopped
+    volatile uint32_t sleeps;     // Tickless sleeps entered
+    volatile uint32_t deep;       // Of which in VLPS
+    volatile uint32_t backwards;  // time_cycles() lower after a sleep than before, must stay 0
+} idle_stats_t;
+
+extern idle_stats_t idle_stats;  // Defined in src/idle.c
+
+extern void idle_init(bool deep);  // Defined in src/idle.c
+extern void idle(void);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define IRQ_VECTORS (16 + 32)  // Cortex-M0+ exceptions and KL25Z interrupts, as tab[] in startup.c
+
+typedef void (*irq_handler_t)(void);
+
+extern void irq_relocate(void);  // Defined in src/irq.c
+extern bool irq_relocated(void);
+extern irq_handler_t irq_attach(IRQn_Type irq, irq_handler_t handler);
+
+/*
+    The vector table tab[] stays in flash with the weak handlers of startup.c until
+    something calls irq_relocate() or irq_attach(). From then on SCB->VTOR points at a
+    copy in SRAM_L and irq_attach() changes an entry with one word store, so a handler
+    can be swapped while its interrupt is enabled: the next exception entry takes the
+    new one, no dispatch table in between.
+    irq is an IRQn_Type, system exceptions included (SysTick_IRQn, PendSV_IRQn).
+*/
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "derivative.h"
+#include "ring.h"
+#include "uart.h"
+
+#ifndef LOG_BUF_SIZE
+#define LOG_BUF_SIZE 256  // Size of the record ring, must be a power of two
+#endif
+_Static_assert(RING_SIZE_OK(LOG_BUF_SIZE), "LOG_BUF_SIZE must be a power of two up to 32768");
+#define LOG_ARGS_MAX 8                          // Arguments per LOG() call
+#define LOG_RECORD_MAX (3 + LOG_ARGS_MAX * 5)  // id, argument count and one 5-byte varint per argument
+
+typedef struct {
+    ring_t ring;
+    volatile uint32_t dropped;  // Records lost because the ring was full
+} log_ring_t;
+
+extern log_ring_t log_ring;  // Defined in src/log.c
+
+extern void log_write(uint16_t id, unsigned nargs, ...);  // Defined in src/log.c
+extern size_t log_flush(UART_Type *UART);
+
+// Never called, only lets the compiler check the arguments against the format
+__attribute__((format(printf, 1, 2))) static inline void log_check(const char *format, ...) { (void)format; }
+
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define LOG_NARGS(...) LOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+/*
+    By default LOG() formats on the target with uart_printf, any terminal can read it.
+    Build with EXTRA_CFLAGS=-DLOG_DEFERRED for deferred logging: LOG() only queues the
+    address of its format string and the raw arguments, the text is never formatted on
+    the target. The format strings live in the .logstr section, which stays in the ELF
+    but is not flashed, and scripts/logdecode.py turns the binary frames sent by
+    log_flush back into text. Every argument must fit in 32 bits (int, long, char,
+    pointer), %s is not supported in either mode so both build from the same calls.
+*/
+#ifdef LOG_DEFERRED
+#define LOG(format, ...)                                                                   \
+    do {                                                                                   \
+        static const char log_format[] __attribute__((section(".logstr"))) = format;       \
+        if (0) log_check(format, ##__VA_ARGS__);                                           \
+        log_write((uint16_t)(uintptr_t)log_format, LOG_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+    } while (0)
+#else
+#define LOG(format, ...) uart_printf(UART_MSG, format, ##__VA_ARGS__)
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Size classes: block size in bytes (a multiple of 4) and block count, see src/pool.c
+#ifndef POOL_SMALL_BLOCKS
+#define POOL_SMALL_BLOCKS 32  // 16-byte blocks: DMA descriptors, small records
+#endif
+#ifndef POOL_MEDIUM_BLOCKS
+#define POOL_MEDIUM_BLOCKS 16  // 64-byte blocks: UART lines, log records
+#endif
+#ifndef POOL_LARGE_BLOCKS
+#define POOL_LARGE_BLOCKS 4  // 256-byte blocks: DMA buffers
+#endif
+#define POOL_CLASSES 3
+
+typedef struct pool_block {
+    struct pool_block *next;
+} pool_block_t;
+
+// One size class, its blocks live in the .pool section reserved by link.ld
+typedef struct {
+    uint8_t *start;              // First block
+    uint8_t *end;                // Past the last block
+    uint8_t *fresh;              // Blocks from here on were never handed out
+    pool_block_t *free;          // Blocks given back by pool_free
+    uint16_t block_size;         // Bytes per block
+    volatile uint16_t used;      // Blocks handed out now
+    volatile uint16_t peak;      // Largest used so far
+    volatile uint32_t failures;  // pool_alloc calls this class could not serve
+} pool_t;
+
+#define POOL_INIT(storage, size) \
+    {(uint8_t *)(storage), (uint8_t *)(storage) + sizeof(storage), (uint8_t *)(storage), NULL, (size), 0, 0, 0}
+
+extern pool_t pools[POOL_CLASSES];  // Defined in src/pool.c, smallest class first
+
+extern void *pool_alloc(size_t size);  // Defined in src/pool.c
+extern void pool_free(void *block);
+
+/*
+    Fixed-size block allocator, callable from interrupts and tasks alike.
+    pool_alloc takes a block of the smallest class that fits and has one left,
+    pool_free gives it back to the class whose range holds it. Both are O(1): a
+    free list pop or push, with a bump pointer for blocks never used yet, so
+    nothing walks the storage at boot. Interrupts are masked only for the pop or push.
+    A block may be handed between contexts by pointer (ISR allocates, task frees).
+*/
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+
+/*
+    Protothreads: stackless coroutines for blocking-style code.
+    A protothread is a function returning pt_status_t, its body sits between
+    PT_BEGIN and PT_END and it is called again and again until it returns PT_ENDED
+    or PT_EXITED. A wait returns to the caller and the next call resumes at that
+    point, so many protothreads share one stack and only cost their pt_t.
+    Local variables are not kept across a wait, put them in a struct or make them
+    static. Use at most one PT_ macro per line and no switch statement in the body.
+*/
+typedef enum {
+    PT_WAITING,  // Blocked in PT_WAIT_UNTIL or PT_DELAY
+    PT_YIELDED,  // Gave up the CPU with PT_YIELD
+    PT_EXITED,   // Left through PT_EXIT
+    PT_ENDED,    // Reached PT_END
+} pt_status_t;
+
+typedef struct {
+    uint16_t lc;  // Line to resume at, 0 to start from PT_BEGIN
+    uint32_t t;   // Start of the running PT_DELAY
+} pt_t;
+
+#define PT_INIT(pt) ((pt)->lc = 0)
+
+#define PT_BEGIN(pt)            \
+    {                           \
+        bool pt_yielded = true; \
+        (void)pt_yielded;       \
+        switch ((pt)->lc) {     \
+            case 0:
+
+#define PT_END(pt)   \
+    }                \
+    (pt)->lc = 0;    \
+    return PT_ENDED; \
+    }
+
+#define PT_WAIT_UNTIL(pt, cond)             \
+    do {                                    \
+        (pt)->lc = __LINE__;                \
+        __attribute__((fallthrough));       \
+        case __LINE__:                      \
+            if (!(cond)) return PT_WAITING; \
+    } while (0)
+
+#define PT_WAIT_WHILE(pt, cond) PT_WAIT_UNTIL(pt, !(cond))
+
+#define PT_YIELD(pt)                            \
+    do {                                        \
+        pt_yielded = false;                     \
+        (pt)->lc = __LINE__;                    \
+        __attribute__((fallthrough));           \
+        case __LINE__:                          \
+            if (!pt_yielded) return PT_YIELDED; \
+    } while (0)
+
+#define PT_EXIT(pt)       \
+    do {                  \
+        (pt)->lc = 0;     \
+        return PT_EXITED; \
+    } while (0)
+
+// Wait ms milliseconds without blocking the other protothreads
+#define PT_DELAY(pt, ms)                                         \
+    do {                                                         \
+        (pt)->t = ms_ticks;                                      \
+        PT_WAIT_UNTIL(pt, ms_ticks - (pt)->t >= (uint32_t)(ms)); \
+    } while (0)
+
+// Run a child protothread to completion, thread is the call to make, e.g. child(&pt_child)
+#define PT_SPAWN(pt, child, thread)               \
+    do {                                          \
+        PT_INIT(child);                           \
+        PT_WAIT_UNTIL(pt, (thread) >= PT_EXITED); \
+    } while (0)
+
+// True while the protothread called in f has not finished
+#define PT_SCHEDULE(f) ((f) < PT_EXITED)
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TPMCLK ((uint32_t)(PLLCLK / 2))  // TPMSRC = 01 with PLLFLLSEL set: MCGPLLCLK / 2, 48 MHz
+
+#define PWM_DUTY_MAX 0x8000U    // Full on, duty is a fraction of PWM_DUTY_MAX
+#define PWM_COUNTS_MAX 0xFFFFU  // MOD stays below 0xFFFF so CnV = MOD + 1 still fits for 100 %
+
+extern uint32_t pwm_init(TPM_Type *tpm, uint32_t freq_hz, uint32_t steps);  // Defined in src/pwm.c
+extern void pwm_channel(TPM_Type *tpm, uint8_t ch, uint8_t pin, uint8_t alt, bool active_low);
+extern void pwm_tone(TPM_Type *tpm, uint8_t ch, uint32_t freq_hz);
+
+/*
+    Edge-aligned PWM on TPM0/1/2, all channels of one TPM share its period.
+    pwm_init picks the largest prescaler that still gives at least steps counts per
+    period at freq_hz and returns the counts per period, 0 if freq_hz cannot be reached.
+    CnV and MOD are double buffered by the TPM: a new value is latched when the counter
+    wraps from MOD to 0, so an update never cuts a period short or doubles an edge,
+    and can be written from anywhere, an ISR included, without masking.
+    CnV = 0 keeps the output inactive, CnV > MOD keeps it active.
+*/
+
+// 0 for TPM0 ... 2 for TPM2, the modules sit 4K apart
+static inline uint32_t pwm_index(TPM_Type *tpm) { return ((uintptr_t)tpm - TPM0_BASE) / (TPM1_BASE - TPM0_BASE); }
+
+static inline uint32_t pwm_period(TPM_Type *tpm) { return tpm->MOD + 1; }
+
+// Counts per period the output is active, latched at the end of the current period
+static inline void pwm_write(TPM_Type *tpm, uint8_t ch, uint32_t counts) { tpm->CONTROLS[ch].CnV = counts; }
+
+// duty from 0 (off) to PWM_DUTY_MAX (on), one multiply, no division
+static inline void pwm_duty(TPM_Type *tpm, uint8_t ch, uint32_t duty) {
+    if (duty > PWM_DUTY_MAX) duty = PWM_DUTY_MAX;
+    pwm_write(tpm, ch, (duty * pwm_period(tpm)) >> 15);
+}
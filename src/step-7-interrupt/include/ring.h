@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Byte ring buffer for one producer and one consumer.
+
+    head is only written by the producer and tail only by the consumer, both are
+    free-running 16-bit indices (a halfword store is atomic on Cortex-M0+), so an
+    ISR and the main loop can share one ring without masking interrupts.
+    The storage size must be a power of two, at most 32768 bytes.
+*/
+typedef struct {
+    volatile uint16_t head;  // Next slot to write, owned by the producer
+    volatile uint16_t tail;  // Next slot to read, owned by the consumer
+    uint16_t mask;           // Storage size - 1
+    uint8_t *buf;            // Storage
+} ring_t;
+
+// Storage sizes the index masking works for, check each buffer size with it
+#define RING_SIZE_OK(n) ((n) > 0 && ((n) & ((n) - 1)) == 0 && (n) <= 32768)
+
+#define RING_INIT(storage) {0, 0, (uint16_t)(sizeof(storage) - 1), (storage)}
+
+static inline size_t ring_count(const ring_t *r) { return (uint16_t)(r->head - r->tail); }
+
+static inline size_t ring_space(const ring_t *r) { return (size_t)r->mask + 1 - ring_count(r); }
+
+static inline bool ring_empty(const ring_t *r) { return r->head == r->tail; }
+
+static inline bool ring_full(const ring_t *r) { return ring_space(r) == 0; }
+
+// Producer side: store one byte, return false if the ring is full
+static inline bool ring_put(ring_t *r, uint8_t byte) {
+    uint16_t head = r->head;
+    if ((uint16_t)(head - r->tail) > r->mask) return false;
+    r->buf[head & r->mask] = byte;
+    r->head = (uint16_t)(head + 1);  // Publish the byte only after it is stored
+    return true;
+}
+
+// Consumer side: fetch one byte, return false if the ring is empty
+static inline bool ring_get(ring_t *r, uint8_t *byte) {
+    uint16_t tail = r->tail;
+    if (tail == r->head) return false;
+    *byte = r->buf[tail & r->mask];
+    r->tail = (uint16_t)(tail + 1);  // Release the slot only after it is read
+    return true;
+}
+
+// Consumer side: read the oldest byte without removing it, return false if the ring is empty
+static inline bool ring_peek(const ring_t *r, uint8_t *byte) {
+    uint16_t tail = r->tail;
+    if (tail == r->head) return false;
+    *byte = r->buf[tail & r->mask];
+    return true;
+}
+
+// Consumer side: discard up to n of the oldest bytes
+static inline void ring_skip(ring_t *r, size_t n) {
+    size_t cnt = ring_count(r);
+    r->tail = (uint16_t)(r->tail + (n < cnt ? n : cnt));
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef SCHED_TASKS
+#define SCHED_TASKS 8  // Tasks including the idle task (main)
+#endif
+#ifndef SCHED_SLICE_MS
+#define SCHED_SLICE_MS 10  // Time slice shared by ready tasks of the same priority
+#endif
+#define SCHED_MSP_WORDS 256  // Handler stack once threads run on PSP
+
+typedef enum {
+    SCHED_READY,
+    SCHED_SLEEPING,  // Waiting for ms_ticks to reach wake
+    SCHED_DONE,      // Returned from its function
+} sched_state_t;
+
+typedef struct {
+    uint32_t *sp;  // Saved PSP, must stay the first member (PendSV_Handler)
+    uint8_t prio;  // Higher runs first, 0 is the idle task
+    volatile sched_state_t state;
+    uint32_t wake;
+} sched_task_t;
+
+typedef struct {
+    volatile uint32_t switches;  // Context switches made by PendSV_Handler
+} sched_stats_t;
+
+typedef void (*sched_fn_t)(void *arg);
+
+extern sched_task_t *volatile sched_cur;  // Defined in src/sched.c
+extern sched_stats_t sched_stats;
+
+/*
+    Preemptive priority scheduler. The highest priority ready task runs, tasks of
+    the same priority share the CPU in SCHED_SLICE_MS slices from SysTick_Handler.
+    Context switches happen in PendSV_Handler, after the deferred work queue was
+    drained. main() becomes the idle task once it calls sched_start: threads run
+    on PSP, handlers on their own MSP stack.
+    stack must be 8-byte aligned, words is its size in 32-bit words.
+*/
+extern bool sched_create(sched_task_t *t, sched_fn_t fn, void *arg, uint32_t *stack, size_t words,
+                         uint8_t prio);  // Defined in src/sched.c
+extern void sched_start(void);
+extern void sched_yield(void);  // Give the CPU to another ready task of the same or a higher priority
+extern void sched_tick(void);
+extern void sched_sleep(uint32_t ms);
+extern uint32_t sched_idle_ticks(void);
+
+static inline bool sched_running(void) { return sched_cur != NULL; }
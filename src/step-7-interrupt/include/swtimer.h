@@ -0,0 +1,40 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef SWTIMER_SLOT_BITS
+#define SWTIMER_SLOT_BITS 5  // 32 slots per wheel level
+#endif
+#ifndef SWTIMER_LEVELS
+#define SWTIMER_LEVELS 4  // Delays up to 2^(5 * 4) ms (17 minutes) are exact, longer ones are re-queued
+#endif
+#define SWTIMER_SLOTS (1U << SWTIMER_SLOT_BITS)
+
+typedef void (*swtimer_callback_t)(void *arg);
+
+typedef struct swtimer {
+    struct swtimer *next;    // Next timer in the same wheel slot
+    struct swtimer **pprev;  // Link pointing at this timer, NULL while stopped
+    uint32_t expires;        // ms_ticks value to fire at
+    uint32_t period;         // Reload in ms, 0 for a one-shot timer
+    swtimer_callback_t callback;
+    void *arg;
+} swtimer_t;
+
+#define SWTIMER_INIT(cb, cb_arg) {NULL, NULL, 0, 0, (cb), (cb_arg)}
+
+/*
+    Hierarchical timer wheel driven by ms_ticks.
+    Starting and stopping is O(1), swtimer_poll costs a constant amount per tick that
+    fires or cascades timers whatever the number of timers, empty ticks are skipped. Callbacks run from swtimer_poll, not
+    from SysTick_Handler, and may start or stop any timer including their own.
+    All functions must be called from the same (thread) context.
+*/
+extern void swtimer_start(swtimer_t *t, uint32_t delay, uint32_t period);  // Defined in src/swtimer.c
+extern void swtimer_stop(swtimer_t *t);
+extern size_t swtimer_poll(void);
+extern uint32_t swtimer_idle_ticks(void);
+
+static inline bool swtimer_active(const swtimer_t *t) { return t->pprev != NULL; }
@@ -4,18 +4,63 @@
 #include <stdbool.h>
 
 extern volatile uint32_t ms_ticks;
+extern volatile uint32_t ms_ticks_hi;
+
+#define SYSTICK_TICKS (CORCLK / 1000)       // Core clock cycles per millisecond tick
+#define SYSTICK_RELOAD (SYSTICK_TICKS - 1)  // SysTick->LOAD after SysTick_Config(SYSTICK_TICKS)
+_Static_assert(SYSTICK_RELOAD <= SysTick_LOAD_RELOAD_Msk, "1 ms SysTick reload does not fit 24 bits");
 
 static inline void spin(volatile uint32_t count) {
     while (count--) asm("nop");
 }
 
-// t: expiration time, prd: period
-static inline bool timer_expired(uint32_t *t, uint32_t prd) {
-    if (ms_ticks + prd < *t) *t = 0;                         // Time wrapped? Reset timer
-    if (*t == 0) *t = ms_ticks + prd;                        // First poll? Set expiration
-    if (*t > ms_ticks) return false;                         // Not expired yet, return
-    *t = (ms_ticks - *t) > prd ? ms_ticks + prd : *t + prd;  // Next expiration time
-    return true;                                             // Expired, return true
+/*
+    Read the 64-bit millisecond count and the SysTick down counter as one consistent pair.
+    The pair is read again if SysTick_Handler ran in between. When the counter has
+    wrapped but the handler could not run yet (interrupts masked, higher priority ISR),
+    VAL is read again and the pending millisecond is added here instead.
+    Assume SysTick_Config(SYSTICK_TICKS), one reload per millisecond.
+*/
+static inline uint64_t systick_read(uint32_t *val) {
+    uint32_t hi, lo;
+    uint64_t ms;
+    do {
+        hi = ms_ticks_hi;
+        lo = ms_ticks;
+        *val = SysTick->VAL;
+        ms = (uint64_t)hi << 32 | lo;
+        if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) *val = SysTick->VAL, ms++;
+    } while (lo != ms_ticks || hi != ms_ticks_hi);
+    return ms;
+}
+
+// Milliseconds since SysTick_Config, never wraps
+static inline uint64_t time_ms(void) {
+    uint32_t val;
+    return systick_read(&val);
+}
+
+// Microseconds since SysTick_Config
+static inline uint64_t time_us(void) {
+    uint32_t val;
+    uint64_t ms = systick_read(&val);
+    return ms * 1000U + (SYSTICK_RELOAD - val) * 1000U / SYSTICK_TICKS;  // reload * 1000 fits 32 bits for a 1 ms tick
+}
+
+// Core clock cycles since SysTick_Config, for latency measurement
+static inline uint64_t time_cycles(void) {
+    uint32_t val;
+    uint64_t ms = systick_read(&val);
+    return ms * SYSTICK_TICKS + (SYSTICK_RELOAD - val);
+}
+
+// t: expiration time, 0 before the first poll, prd: period in ms
+static inline bool timer_expired(uint64_t *t, uint32_t prd) {
+    uint64_t now = time_ms();
+    if (*t == 0) *t = now + prd;                   // First poll? Set expiration
+    if (*t > now) return false;                    // Not expired yet, return
+    *t = (now - *t) > prd ? now + prd : *t + prd;  // Next expiration time, skip missed periods
+    return true;                                   // Expired, return true
 }
 
 static inline void delay_ms(uint32_t ms) {
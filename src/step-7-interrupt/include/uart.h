@@ -1,22 +1,106 @@
 #pragma once
 
+#include "bme.h"
 #include "derivative.h"
+#include "dma.h"
+#include "format.h"
+#include "pt.h"
+#include "ring.h"
+#include "sched.h"
 #include "systick.h"
 #include <stdarg.h>
+#ifdef FMT_NEWLIB
 #include <stdio.h>
-#include <string.h>
+#endif
 
-static inline void uart_init(UART_Type *UART, unsigned long baud) {
+#ifndef UART_TX_BUF_SIZE
+#define UART_TX_BUF_SIZE 256  // Size of each TX ring, must be a power of two
+#endif
+#ifndef UART_RX_BUF_SIZE
+#define UART_RX_BUF_SIZE 64  // Size of each RX ring, must be a power of two
+#endif
+_Static_assert(RING_SIZE_OK(UART_TX_BUF_SIZE), "UART_TX_BUF_SIZE must be a power of two up to 32768");
+_Static_assert(RING_SIZE_OK(UART_RX_BUF_SIZE), "UART_RX_BUF_SIZE must be a power of two up to 32768");
+
+// What uart_write_buf does when the TX ring is full
+typedef enum {
+    UART_TX_BLOCK,      // Wait until the ISR frees space (default)
+    UART_TX_DROP,       // Queue what fits and discard the rest
+    UART_TX_OVERWRITE,  // Discard the oldest queued bytes to make room
+} uart_tx_policy_t;
+
+typedef struct {
+    ring_t ring;
+    uart_tx_policy_t policy;
+    dma_callback_t dma_done;  // Completion callback of the running uart_write_dma
+    void *dma_arg;
+} uart_tx_t;
+
+typedef struct {
+    ring_t ring;
+    volatile uint32_t overruns;  // Bytes lost because the ring or the data register was full
+} uart_rx_t;
+
+// Line assembler state, fed from the RX ring by uart_line_poll
+typedef struct {
+    char *buf;    // Line storage, always NUL terminated
+    size_t size;  // Storage size, a line is cut at size - 1 bytes
+    size_t len;   // Bytes assembled so far
+    char delim;   // Line delimiter, kept in the line
+    bool done;    // The line in buf was returned, start a new one on the next poll
+} uart_line_t;
+
+#define UART_LINE_INIT(storage, delimiter) {(storage), sizeof(storage), 0, (delimiter), false}
+
+extern uart_tx_t uart1_tx;  // Defined in src/uart.c
+extern uart_tx_t uart2_tx;
+extern uart_rx_t uart1_rx;
+extern uart_rx_t uart2_rx;
+
+extern void uart_dma_done(uint8_t ch, bool error, void *arg);  // Defined in src/uart.c
+
+// TX queue of UART1/UART2, NULL for a UART without one
+static inline uart_tx_t *uart_tx(UART_Type *UART) {
+    if (UART == UART1) return &uart1_tx;
+    if (UART == UART2) return &uart2_tx;
+    return NULL;
+}
+
+// RX queue of UART1/UART2, NULL for a UART without one
+static inline uart_rx_t *uart_rx(UART_Type *UART) {
+    if (UART == UART1) return &uart1_rx;
+    if (UART == UART2) return &uart2_rx;
+    return NULL;
+}
+
+/*
+    Baud = BUSCLK / (16 * SBR), SBR rounded to the nearest divider at compile time.
+    UART_BAUD_OK: SBR fits 13 bits and the rate is within 3% of the one asked for.
+*/
+#define UART_SBR(baud) ((BUSCLK + 8UL * (baud)) / (16UL * (baud)))
+#define UART_SBR_CLK(baud) (16ULL * (baud) * UART_SBR(baud))  // BUSCLK that would give baud exactly
+#define UART_BAUD_ERR(baud) (UART_SBR_CLK(baud) > BUSCLK ? UART_SBR_CLK(baud) - BUSCLK : BUSCLK - UART_SBR_CLK(baud))
+#define UART_BAUD_OK(baud) \
+    (UART_SBR(baud) >= 1 && UART_SBR(baud) <= 0x1FFF && UART_BAUD_ERR(baud) * 100 <= 3ULL * BUSCLK)
+
+// baud must be a constant, so the divider is computed and checked by the compiler
+#define uart_init(UART, baud)                                                   \
+    do {                                                                        \
+        _Static_assert(UART_BAUD_OK(baud), "baud rate out of reach of BUSCLK"); \
+        uart_init_sbr((UART), (uint16_t)UART_SBR(baud));                        \
+    } while (0)
+
+static inline void uart_init_sbr(UART_Type *UART, uint16_t sbr) {
     // Enable clock for UART and PORT, then set RXD, TXD
     if (UART == UART1) {
-        SIM->SCGC4 |= SIM_SCGC4_UART1_MASK;
-        SIM->SCGC5 |= SIM_SCGC5_PORTC_MASK;
+        BME_OR(SIM->SCGC4, SIM_SCGC4_UART1_MASK);
+        BME_OR(SIM->SCGC5, SIM_SCGC5_PORTC_MASK);
 
         PORTC->PCR[3] = PORT_PCR_MUX(0x3);
         PORTC->PCR[4] = PORT_PCR_MUX(0x3);
     } else if (UART == UART2) {
-        SIM->SCGC4 |= SIM_SCGC4_UART2_MASK;
-        SIM->SCGC5 |= SIM_SCGC5_PORTE_MASK;
+        BME_OR(SIM->SCGC4, SIM_SCGC4_UART2_MASK);
+        BME_OR(SIM->SCGC5, SIM_SCGC5_PORTE_MASK);
 
         PORTE->PCR[23] = PORT_PCR_MUX(0x3);
         PORTE->PCR[22] = PORT_PCR_MUX(0x3);
@@ -24,21 +108,25 @@ static inline void uart_init(UART_Type *UART, unsigned long baud) {
         return;
 
     // Make sure that the transmitter and receiver are disabled while we change settings.
-    UART->C2 &= (uint8_t)(~(UART_C2_TE_MASK | UART_C2_RE_MASK));
+    BME_AND(UART->C2, ~(UART_C2_TE_MASK | UART_C2_RE_MASK | UART_C2_TIE_MASK));
+
+    // Start with empty queues, bytes are moved by the UART interrupt
+    uart_tx_t *tx = uart_tx(UART);
+    uart_rx_t *rx = uart_rx(UART);
+    tx->ring.tail = tx->ring.head;
+    rx->ring.tail = rx->ring.head;
+    rx->overruns = 0;
+    NVIC_EnableIRQ(UART == UART1 ? UART1_IRQn : UART2_IRQn);
 
     // default settings, no parity, so entire register is cleared
     UART->C1 = 0x00;
 
-    // Buad = BUSCLK / (16 * SBR)
-    unsigned short sbr = (unsigned short)(BUSCLK / (baud * 16));
-
-    // UARTx_BDH bits 0~4 is the high 5 bits of SBR (band rate)
-    UART->BDH |= (sbr & (uint8_t)(UART_BDH_SBR_MASK << 8)) >> 8;
+    // UARTx_BDH bits 0~4 is the high 5 bits of SBR (band rate), the other BDH bits are kept
+    BME_BFI(UART->BDH, UART_BDH_SBR_SHIFT, 5, sbr >> 8);
     // UARTx_BLH is the low 8 bits of SBR (band rate)
     UART->BDL = sbr & UART_BDL_SBR_MASK;
     // Enable receiver and transmitter
-    UART->C2 |= UART_C2_TE_MASK     // Transmitter enable
-                | UART_C2_RE_MASK;  // Receiver enable
+    BME_OR(UART->C2, UART_C2_TE_MASK | UART_C2_RE_MASK);
 }
 
 static inline void uart_rie_enable(UART_Type *UART) {
@@ -47,7 +135,7 @@ static inline void uart_rie_enable(UART_Type *UART) {
         NVIC_EnableIRQ(UART1_IRQn);
     else if (UART == UART2)
         NVIC_EnableIRQ(UART2_IRQn);
-    UART->C2 |= UART_C2_RIE_MASK;  // Receiver interrupt enable
+    BME_OR(UART->C2, UART_C2_RIE_MASK);  // Receiver interrupt enable
 }
 
 static inline int uart_read_ready(UART_Type *UART) {
@@ -57,25 +145,195 @@ static inline int uart_read_ready(UART_Type *UART) {
 
 static inline uint8_t uart_read_byte(UART_Type *UART) { return (uint8_t)UART->D; }
 
-static inline void uart_write_byte(UART_Type *UART, uint8_t byte) {
+// Called from UARTx_IRQHandler: move one received byte into the RX ring, nothing else
+static inline void uart_rx_irq(UART_Type *UART) {
+    uint8_t s1 = UART->S1;
+    if (!(s1 & (UART_S1_RDRF_MASK | UART_S1_OR_MASK))) return;
+    uint8_t byte = (uint8_t)UART->D;  // Reading S1 then D clears RDRF and OR
+    uart_rx_t *rx = uart_rx(UART);
+    bool stored = ring_put(&rx->ring, byte);  // With OR set D still holds the last good byte, keep it
+    if (!stored || (s1 & UART_S1_OR_MASK)) rx->overruns++;
+}
+
+// Fetch one byte received by the interrupt, return false if none is waiting
+static inline bool uart_rx_get(UART_Type *UART, uint8_t *byte) { return ring_get(&uart_rx(UART)->ring, byte); }
+
+/*
+    Assemble a line from the RX ring without blocking.
+    Return the line length once the delimiter arrives or the storage is full,
+    0 while the line is still incomplete. The next call starts a new line.
+*/
+static inline size_t uart_line_poll(UART_Type *UART, uart_line_t *line) {
+    uint8_t byte;
+    if (line->done) line->len = 0, line->done = false;
+    while (uart_rx_get(UART, &byte)) {
+        line->buf[line->len++] = (char)byte;
+        line->done = (char)byte == line->delim || line->len >= line->size - 1;
+        if (line->done) break;
+    }
+    line->buf[line->len] = '\0';
+    return line->done ? line->len : 0;
+}
+
+static inline void uart_tx_policy(UART_Type *UART, uart_tx_policy_t policy) { uart_tx(UART)->policy = policy; }
+
+static inline void uart_write_byte_poll(UART_Type *UART, uint8_t byte) {
     // Transmit Data Register Empty Flag (TDRE): set when the transmit data buffer is empty
     while (!(UART->S1 & UART_S1_TDRE_MASK)) asm("nop");
     UART->D = byte;
 }
 
-static inline void uart_write_buf(UART_Type *UART, char *buf, size_t len) {
-    while (len-- > 0) uart_write_byte(UART, *(uint8_t *)buf++);
+// Called from UARTx_IRQHandler: move the next queued byte into the data register
+static inline void uart_tx_irq(UART_Type *UART) {
+    uint8_t byte;
+    if (UART->C4 & UART_C4_TDMAS_MASK) return;  // TDRE belongs to uart_write_dma
+    if (!(UART->C2 & UART_C2_TIE_MASK) || !(UART->S1 & UART_S1_TDRE_MASK)) return;
+    if (ring_get(&uart_tx(UART)->ring, &byte))
+        UART->D = byte;
+    else
+        BME_AND(UART->C2, ~UART_C2_TIE_MASK);  // Queue drained, stop TDRE interrupts
 }
 
-static inline void uart_printf(UART_Type *UART, const char *format, ...) {
+/*
+    Queue up to len bytes without waiting for the wire, return how many were queued.
+    The puts run with interrupts masked, the ring has one producer at a time and the
+    bytes of one call stay together; masking lasts about ten cycles per byte.
+    UART_TX_BLOCK unmasks briefly while it waits for the ISR, another writer may slip
+    in there. In a handler or with interrupts masked it drains the ring by polling,
+    except while uart_write_dma owns TDRE: only its completion work empties the ring
+    then, which cannot run here, so the count comes back short instead.
+*/
+static inline size_t uart_write_buf(UART_Type *UART, const char *buf, size_t len) {
+    uart_tx_t *tx = uart_tx(UART);
+    if (tx == NULL) {
+        for (size_t i = 0; i < len; i++) uart_write_byte_poll(UART, (uint8_t)buf[i]);
+        return len;
+    }
+
+    size_t cnt = 0;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    while (cnt < len) {
+        if (ring_put(&tx->ring, (uint8_t)buf[cnt])) {
+            cnt++;
+            continue;
+        }
+        if (tx->policy == UART_TX_DROP) break;
+        if (tx->policy == UART_TX_OVERWRITE) {
+            ring_skip(&tx->ring, 1);  // Take the oldest byte away from the ISR
+        } else if (primask || __get_IPSR()) {
+            if (UART->C4 & UART_C4_TDMAS_MASK) break;
+            uart_tx_irq(UART);  // Blocking where the UART IRQ cannot run: drain by polling
+        } else {
+            BME_OR(UART->C2, UART_C2_TIE_MASK);
+            __set_PRIMASK(primask);  // Let the ISR free space
+            __disable_irq();
+        }
+    }
+    __set_PRIMASK(primask);
+    BME_OR(UART->C2, UART_C2_TIE_MASK);  // Kick the transmitter
+    return cnt;
+}
+
+static inline bool uart_write_byte(UART_Type *UART, uint8_t byte) {
+    return uart_write_buf(UART, (const char *)&byte, 1) == 1;
+}
+
+/*
+    Send len bytes from buf by DMA, the CPU is not involved per byte.
+    buf must stay untouched until done(ch, error, arg) is called from the DMA interrupt.
+    Bytes already queued by uart_write_buf go out first; bytes queued while the
+    transfer runs wait in the TX ring. Return false, without waiting, if a transfer
+    is still running or queued bytes have not left yet: try again later.
+*/
+static inline bool uart_write_dma(UART_Type *UART, const void *buf, size_t len, dma_callback_t done, void *arg) {
+    uart_tx_t *tx = uart_tx(UART);
+    uint8_t ch = UART == UART1 ? DMA_CH_UART1_TX : DMA_CH_UART2_TX;
+    if (tx == NULL || len == 0 || len > (DMA_DSR_BCR_BCR_MASK >> DMA_DSR_BCR_BCR_SHIFT)) return false;
+    if (dma_busy(ch) || (UART->C4 & UART_C4_TDMAS_MASK) || !ring_empty(&tx->ring)) return false;
+
+    tx->dma_done = done;
+    tx->dma_arg = arg;
+    BME_AND(UART->C2, ~UART_C2_TIE_MASK);
+    BME_OR(UART->C4, UART_C4_TDMAS_MASK);  // TDRE raises a DMA request instead of an interrupt
+    /*
+        ERQ: Enable Peripheral Request, CS: Cycle Steal (one byte per request),
+        D_REQ: clear ERQ when the byte count reaches 0, SINC: Source Increment
+    */
+    dma_start(ch, UART == UART1 ? DMA_SRC_UART1_TX : DMA_SRC_UART2_TX, buf, &UART->D, (uint32_t)len,
+              DMA_DCR_ERQ_MASK | DMA_DCR_CS_MASK | DMA_DCR_D_REQ_MASK | DMA_DCR_SINC_MASK |
+                  DMA_DCR_SSIZE(DMA_SIZE_8) | DMA_DCR_DSIZE(DMA_SIZE_8),
+              uart_dma_done, UART);
+    BME_OR(UART->C2, UART_C2_TIE_MASK);
+    return true;
+}
+
+/*
+    Wait until every queued byte has left the shift register. A task sleeps between
+    checks. In a handler or with interrupts masked the ring is drained by polling,
+    a running uart_write_dma cannot finish there: return false instead of waiting.
+*/
+static inline bool uart_flush(UART_Type *UART) {
+    uart_tx_t *tx = uart_tx(UART);
+    while (tx != NULL && (!ring_empty(&tx->ring) || (UART->C4 & UART_C4_TDMAS_MASK))) {
+        if (__get_PRIMASK() || __get_IPSR()) {
+            if (UART->C4 & UART_C4_TDMAS_MASK) return false;
+            uart_tx_irq(UART);
+        } else if (sched_running())
+            sched_sleep(1);  // Returns at once in the idle task, which any interrupt and PendSV preempt
+    }
+    while (!(UART->S1 & UART_S1_TC_MASK)) asm("nop");  // At most one character time
+    return true;
+}
+
+static inline void uart_putc(char c, void *arg) { uart_write_byte((UART_Type *)arg, (uint8_t)c); }
+
+#define UART_PRINTF_BUF 64  // Bytes uart_printf formats before queueing them
+
+typedef struct {
+    UART_Type *UART;
+    size_t len;
+    char buf[UART_PRINTF_BUF];
+} uart_printf_t;
+
+static inline void uart_printf_putc(char c, void *arg) {
+    uart_printf_t *out = (uart_printf_t *)arg;
+    out->buf[out->len++] = c;
+    if (out->len == sizeof(out->buf)) {
+        uart_write_buf(out->UART, out->buf, out->len);
+        out->len = 0;
+    }
+}
+
+/*
+    Formats into a UART_PRINTF_BUF stack buffer and queues it with one uart_write_buf,
+    so lines up to that size from different tasks never interleave. Longer output goes
+    out in UART_PRINTF_BUF pieces. Build with EXTRA_CFLAGS=-DFMT_NEWLIB to format with
+    newlib's vsnprintf instead, only meant for comparing size and cycles (make size).
+*/
+__attribute__((format(printf, 2, 3))) static inline void uart_printf(UART_Type *UART, const char *format, ...) {
     va_list args;
     va_start(args, format);
-    char buf[64];
-    vsprintf(buf, format, args);
-    uart_write_buf(UART, buf, strlen(buf));
+#ifdef FMT_NEWLIB
+    char buf[UART_PRINTF_BUF];
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    if (len > 0) uart_write_buf(UART, buf, (size_t)len < sizeof(buf) ? (size_t)len : sizeof(buf) - 1);
+#else
+    uart_printf_t out = {UART, 0, {0}};
+    fmt_vprintf(uart_printf_putc, &out, format, args);
+    if (out.len > 0) uart_write_buf(UART, out.buf, out.len);
+#endif
     va_end(args);
 }
 
+// Protothread form of uart_getline: wait for a line from the RX ring, its length is in line->len
+static inline pt_status_t uart_getline_pt(pt_t *pt, UART_Type *UART, uart_line_t *line) {
+    PT_BEGIN(pt);
+    PT_WAIT_UNTIL(pt, uart_line_poll(UART, line) > 0);
+    PT_END(pt);
+}
+
+// Blocking read of a line straight from the data register, only usable while RIE is off
 static inline size_t uart_getline(UART_Type *UART, char *buf) {
     size_t cnt = 0;
     while (1) {
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "derivative.h"
+#include "dma.h"
+#include "pwm.h"
+#include "work.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WAVE_PERIOD 0xFF  // Target MOD, the period of the whole TPM, instead of a channel's CnV
+
+// Called as deferred work with a table the DMA has finished and no longer reads
+typedef void (*wave_done_t)(const uint16_t *table, void *arg);
+
+typedef struct {
+    volatile uint32_t tables;     // Tables played to the end
+    volatile uint32_t underruns;  // Tables repeated or stopped because nothing was queued, or never handed back
+    volatile uint32_t errors;     // DMA transfers stopped on a bus or configuration error
+} wave_stats_t;
+
+extern wave_stats_t wave_stats;  // Defined in src/wave.c
+
+extern void wave_start(TPM_Type *tpm, uint8_t target, const uint16_t *table, size_t count, bool loop,
+                       wave_done_t done, void *arg);  // Defined in src/wave.c
+extern bool wave_queue(const uint16_t *table, size_t count);
+extern void wave_stop(void);
+extern void wave_irq(void);
+
+/*
+    Table playback into a running PWM (see pwm.h): on every overflow of tpm the
+    TPM raises a DMA request and DMA_CH_WAVE writes the next 16-bit entry of the
+    table into CnV of channel target, or into MOD for WAVE_PERIOD. The TPM latches
+    it at the following wrap, so each entry lasts exactly one period and the CPU
+    does nothing per step. Entries are counts as for pwm_write; a period table keeps
+    the channel's CnV, write one that fits the shortest period first.
+    At the end of a table wave_irq plays the table queued by wave_queue, if any,
+    and hands the finished one to done; without a queued table it plays the same
+    table again when loop is set, else it stops and hands it over.
+    Streaming is two buffers: start with one, queue the other, refill and queue
+    each table done returns. The switch happens in the interrupt, a late wave_irq
+    only stretches the last entry. Two finished tables wait for done; should the work
+    fall further behind, the next one is not handed back and counts as an underrun.
+    One playback at a time, up to 0x7FFFF entries.
+*/
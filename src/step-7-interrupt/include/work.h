@@ -0,0 +1,52 @@
+#pragma once
+
+#include "derivative.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*work_fn_t)(void *arg);
+
+// Deferred work item, owned by its poster and never copied while queued
+typedef struct work {
+    struct work *next;
+    work_fn_t fn;
+    void *arg;
+    volatile bool queued;  // Posted and not started yet
+} work_t;
+
+typedef struct {
+    work_t *head;
+    work_t *tail;
+    volatile uint32_t runs;  // Work items executed
+} work_queue_t;
+
+#define WORK_INIT(work_fn, work_arg) {NULL, (work_fn), (work_arg), false}
+
+extern work_queue_t work_queue;  // Defined in src/work.c
+
+extern void work_init(void);  // Defined in src/work.c
+extern void work_run(void);
+
+/*
+    Bottom halves: an ISR does the time critical part (acknowledge, move a byte)
+    and posts the rest, which PendSV_Handler runs at the lowest priority once no
+    other interrupt is active. Items run in posting order. Posting an item that is
+    already queued does nothing, so an interrupt firing at a high rate holds one
+    place in the queue and cannot push the others back.
+    Callable from any context, the tail is appended to with interrupts masked.
+*/
+static inline void work_post(work_t *w) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!w->queued) {
+        w->queued = true;
+        w->next = NULL;
+        if (work_queue.tail != NULL)
+            work_queue.tail->next = w;
+        else
+            work_queue.head = w;
+        work_queue.tail = w;
+    }
+    __set_PRIMASK(primask);
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
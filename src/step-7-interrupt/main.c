@@ -1,22 +1,317 @@
+#include "adc.h"
 #include "derivative.h"
+#include "gpio.h"
+#include "heap.h"
+#include "idle.h"
+#include "irq.h"
+#include "log.h"
+#include "pool.h"
+#include "pt.h"
+#include "pwm.h"
+#include "sched.h"
+#include "swtimer.h"
 #include "systick.h"
 #include "uart.h"
+#include "wave.h"
+#include "work.h"
 #include <stdio.h>
 #include <string.h>
 
+#ifdef FMT_BENCH
+static void fmt_discard(char c, void *arg) { (void)c, (void)arg; }
+
+// Core cycles spent formatting one status line
+static uint32_t fmt_bench(void) {
+    uint64_t start = time_cycles();
+#ifdef FMT_NEWLIB
+    char buf[64];
+    snprintf(buf, sizeof(buf), "UART RD: %d, tick: %lu\r\n", 1, 4294967295UL);
+#else
+    fmt_printf(fmt_discard, NULL, "UART RD: %d, tick: %lu\r\n", 1, 4294967295UL);
+#endif
+    return (uint32_t)(time_cycles() - start);
+}
+#endif
+
+#ifdef RAMFUNC_BENCH
+#define RAMFUNC_BENCH_ROUNDS 1000
+
+// The same loop twice, once in flash and once in SRAM; it branches, loads and multiplies
+#define RAMFUNC_BENCH_KERNEL(name, attr)                                    \
+    attr static uint32_t name(const uint32_t *data, size_t n) {             \
+        uint32_t hash = 2166136261u;                                        \
+        for (size_t i = 0; i < n; i++) hash = (hash ^ data[i]) * 16777619u; \
+        return hash;                                                        \
+    }
+RAMFUNC_BENCH_KERNEL(kernel_flash, __attribute__((noinline)))
+RAMFUNC_BENCH_KERNEL(kernel_ram, RAMFUNC)
+
+// Core cycles for RAMFUNC_BENCH_ROUNDS words, run from flash or from SRAM
+static uint32_t ramfunc_bench(uint32_t (*kernel)(const uint32_t *, size_t)) {
+    static uint32_t data[RAMFUNC_BENCH_ROUNDS];
+    uint64_t start = time_cycles();
+    volatile uint32_t hash = kernel(data, RAMFUNC_BENCH_ROUNDS);
+    (void)hash;
+    return (uint32_t)(time_cycles() - start);
+}
+#endif
+
+#ifdef ADC_DEMO
+#define ADC_DEMO_CHANNEL 8    // ADC0_SE8 on PTB0, header A0
+#define ADC_DEMO_RATE 10000U  // Samples per second
+
+static volatile uint32_t adc_mean;
+
+// Runs once per ADC_BLOCK_SAMPLES samples, never per sample
+static void adc_block(const uint16_t *samples, size_t count, void *arg) {
+    (void)arg;
+    if (count == 0) return;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < count; i++) sum += samples[i];
+    adc_mean = sum / count;
+}
+#endif
+
+#ifdef GPIO_BENCH
+#define GPIO_BENCH_PIN GPIO_PIN(GPIO_C, 9)  // PTC9, watch it on a scope
+#define GPIO_BENCH_ROUNDS 1000
+
+// Eight PTOR stores per round, through the peripheral bridge or the IOPORT, both run from SRAM
+#define TOGGLE_8(store) store, store, store, store, store, store, store, store
+
+RAMFUNC static void toggle_gpio(uint32_t n) {
+    while (n--) TOGGLE_8(GPIOC->PTOR = gpio_mask(GPIO_BENCH_PIN));
+}
+
+RAMFUNC static void toggle_fgpio(uint32_t n) {
+    while (n--) TOGGLE_8(gpio_toggle(GPIO_BENCH_PIN));
+}
+
+// Core cycles for 8 * GPIO_BENCH_ROUNDS toggles, f_toggle = CORCLK * 8000 / cycles
+static uint32_t gpio_bench(void (*toggle)(uint32_t)) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();  // No interrupt in the middle of the burst
+    uint64_t start = time_cycles();
+    toggle(GPIO_BENCH_ROUNDS);
+    uint32_t cycles = (uint32_t)(time_cycles() - start);
+    __set_PRIMASK(primask);
+    return cycles;
+}
+#endif
+
+#ifdef SCHED_BENCH
+#define SCHED_BENCH_ROUNDS 1000
+static sched_task_t ping_task, pong_task;
+static uint32_t ping_stack[128] __attribute__((aligned(8))) SRAM_L;
+static uint32_t pong_stack[128] __attribute__((aligned(8))) SRAM_L;
+
+// Two tasks of the same priority yield to each other, every yield is one context switch
+static void ping_pong(void *arg) {
+    uint64_t start = time_cycles();
+    for (int i = 0; i < SCHED_BENCH_ROUNDS; i++) sched_yield();
+    uint32_t cycles = (uint32_t)((time_cycles() - start) / (2 * SCHED_BENCH_ROUNDS));
+    if (arg != NULL) LOG("Context switch: %lu cycles\r\n", cycles);
+}
+#endif
+
+// RGB LED, active low, one TPM channel per colour
+#define LED_RED TPM2, 0    // PTB18, TPM2_CH0 at ALT3
+#define LED_GREEN TPM2, 1  // PTB19, TPM2_CH1 at ALT3
+#define LED_BLUE TPM0, 1   // PTD1, TPM0_CH1 at ALT4
+#define LED_PWM_HZ 1000U   // Well above visible flicker
+#define LED_PWM_STEPS 256U
+#define LED_GLOW (PWM_DUTY_MAX / 8)
+
+// Passive piezo buzzer between PTA12 (TPM1_CH0 at ALT3) and ground, TPM1 is its own
+#define BUZZER TPM1, 0
+#define BUZZER_LOW_HZ 100U  // Lowest tone pwm_tone must reach
+#define BUZZER_BEEP_HZ 2000U
+
+// All outputs in hardware, off until a duty or tone is written
+static void pwm_outputs_init(void) {
+    pwm_init(TPM2, LED_PWM_HZ, LED_PWM_STEPS);
+    pwm_init(TPM0, LED_PWM_HZ, LED_PWM_STEPS);
+    pwm_channel(LED_RED, GPIO_PIN(GPIO_B, 18), 3, true);
+    pwm_channel(LED_GREEN, GPIO_PIN(GPIO_B, 19), 3, true);
+    pwm_channel(LED_BLUE, GPIO_PIN(GPIO_D, 1), 4, true);
+    pwm_init(TPM1, BUZZER_LOW_HZ, 2);
+    pwm_channel(BUZZER, GPIO_PIN(GPIO_A, 12), 3, false);
+}
+
+#ifdef IRQ_DEMO
+static volatile uint32_t irq_overflows;
+
+// Attached at run time, startup.c only has the weak TPM2_IRQHandler
+static void led_overflow(void) {
+    BME_OR(TPM2->SC, TPM_SC_TOF_MASK);  // TOF is write-1-to-clear
+    irq_overflows++;
+}
+#endif
+
+#ifdef WAVE_DEMO
+#define WAVE_DEMO_ENTRIES 64  // Per buffer, one entry per 1 ms LED PWM period
+
+static uint16_t wave_buf[2][WAVE_DEMO_ENTRIES];
+static uint32_t wave_phase;
+
+// Next entries of a 2 s breath on the blue LED: triangle 0 to 1023 and back, squared to look even
+static void wave_fill(uint16_t *table) {
+    uint32_t period = pwm_period(TPM0);
+    for (size_t i = 0; i < WAVE_DEMO_ENTRIES; i++) {
+        uint32_t level = wave_phase < 1024 ? wave_phase : 2047 - wave_phase;
+        table[i] = (uint16_t)((level * level * period) >> 20);
+        wave_phase = (wave_phase + 1) & 2047;
+    }
+}
+
+// Runs as work once per table, the DMA plays the other one meanwhile
+static void wave_refill(const uint16_t *table, void *arg) {
+    (void)arg;
+    uint16_t *next = wave_buf[table == wave_buf[0] ? 0 : 1];
+    wave_fill(next);
+    wave_queue(next, WAVE_DEMO_ENTRIES);
+}
+#endif
+
+static sched_task_t io_task;
+static uint32_t io_stack[128] __attribute__((aligned(8))) SRAM_L;
+
+// Report received lines, written as if uart_getline blocked
+static pt_status_t line_report(pt_t *pt) {
+    static pt_t getline;
+    static char buf[64];
+    static uart_line_t line = UART_LINE_INIT(buf, '\n');
+    PT_BEGIN(pt);
+    for (;;) {
+        PT_SPAWN(pt, &getline, uart_getline_pt(&getline, UART_MSG, &line));
+#ifdef POOL_DEMO
+        {
+            // The line moves to a pool block, buf could take the next line while the copy is in use
+            char *copy = pool_alloc(line.len + 1);
+            if (copy != NULL) {
+                memcpy(copy, buf, line.len + 1);
+                LOG("Line: %u bytes, first '%c'\r\n", (unsigned)line.len, copy[0]);
+                pool_free(copy);
+            }
+        }
+#else
+        LOG("Line: %u bytes, first '%c'\r\n", (unsigned)line.len, buf[0]);
+#endif
+        pwm_tone(BUZZER, BUZZER_BEEP_HZ);
+        PT_DELAY(pt, 50);
+        pwm_tone(BUZZER, 0);
+    }
+    PT_END(pt);
+}
+
+// Blink the green LED twice a second as a sequence of delays, the TPM does the dimming
+static pt_status_t heartbeat(pt_t *pt) {
+    PT_BEGIN(pt);
+    for (;;) {
+        pwm_duty(LED_GREEN, LED_GLOW);
+        PT_DELAY(pt, 50);
+        pwm_duty(LED_GREEN, 0);
+        PT_DELAY(pt, 100);
+        pwm_duty(LED_GREEN, LED_GLOW);
+        PT_DELAY(pt, 50);
+        pwm_duty(LED_GREEN, 0);
+        PT_DELAY(pt, 800);
+    }
+    PT_END(pt);
+}
+
+// One task, one stack, several protothreads interleaved
+static void io_thread(void *arg) {
+    (void)arg;
+    pt_t line_pt, heartbeat_pt;
+    PT_INIT(&line_pt);
+    PT_INIT(&heartbeat_pt);
+    for (;;) {
+        line_report(&line_pt);
+        heartbeat(&heartbeat_pt);
+        sched_sleep(10);
+    }
+}
+
+static void status(void *arg) {
+    (void)arg;
+    LOG("UART RD: %d, tick: %lu\r\n", UART_MSG->S1 & UART_S1_RDRF_MASK ? 1 : 0, ms_ticks);
+    LOG("Idle: %lu ms in %lu sleeps, %lu switches, %lu backwards\r\n", idle_stats.sleep_ms, idle_stats.sleeps,
+        sched_stats.switches, idle_stats.backwards);
+    LOG("Heap: %lu bytes, peak %lu of %lu\r\n", heap_stats.current, heap_stats.peak, heap_stats.size);
+#ifdef WAVE_DEMO
+    LOG("Wave: %lu tables, %lu underruns\r\n", wave_stats.tables, wave_stats.underruns);
+#endif
+#ifdef POOL_DEMO
+    for (size_t i = 0; i < POOL_CLASSES; i++)
+        LOG("Pool %u: %u used, peak %u, %lu failures\r\n", pools[i].block_size, pools[i].used, pools[i].peak,
+            pools[i].failures);
+#endif
+#ifdef IRQ_DEMO
+    LOG("TPM2: %lu overflows\r\n", irq_overflows);
+#endif
+#ifdef ADC_DEMO
+    LOG("ADC: mean %lu, %lu blocks, %lu dropped\r\n", adc_mean, adc_stats.blocks, adc_stats.dropped);
+#endif
+}
+
 int main(void) {
     // Initialize
-    SysTick_Config(CORCLK / 1000);  // Period of systick timer : 1ms
-    uart_init(UART_MSG, 9600);      // Initialize UART1 with PC
-    uart_rie_enable(UART_MSG);      // Enable UART1 receive interrupt
+    SysTick_Config(SYSTICK_TICKS);           // Period of systick timer : 1ms
+    work_init();                             // Bottom halves run from PendSV
+    uart_init(UART_MSG, 9600);               // Initialize UART1 with PC
+    uart_rie_enable(UART_MSG);               // Enable UART1 receive interrupt
+    uart_tx_policy(UART_MSG, UART_TX_DROP);  // Never stall the loop on a slow wire
+    idle_init(false);                        // Sleep between timers, stay awake for UART RX
+    pwm_outputs_init();                      // RGB LED and buzzer on TPM0/1/2
+#ifdef WAVE_DEMO
+    wave_fill(wave_buf[0]);
+    wave_fill(wave_buf[1]);
+    wave_start(LED_BLUE, wave_buf[0], WAVE_DEMO_ENTRIES, true, wave_refill, NULL);
+    wave_queue(wave_buf[1], WAVE_DEMO_ENTRIES);
+#endif
+#ifdef IRQ_DEMO
+    irq_attach(TPM2_IRQn, led_overflow);  // Vector table moves to SRAM_L here
+    BME_OR(TPM2->SC, TPM_SC_TOIE_MASK);   // One interrupt per LED PWM period
+    NVIC_EnableIRQ(TPM2_IRQn);
+#endif
+
+    LOG("System Clock: %lu\r\n", CORCLK);
+    LOG("Bus Clock: %lu\r\n", BUSCLK);
+#ifdef CLOCK_VERIFY
+    LOG("Clock check: core %lu, bus %lu, match %d\r\n", clock_decoded_core, clock_decoded_bus,
+        clock_decoded_core == CORCLK && clock_decoded_bus == BUSCLK);
+#endif
+    LOG("Boot: %lu cycles to main\r\n", boot_cycles);
+#ifdef FMT_BENCH
+    LOG("Format cycles: %lu\r\n", fmt_bench());
+#endif
+#ifdef GPIO_BENCH
+    gpio_output(GPIO_BENCH_PIN, false);
+    LOG("Toggle cycles: gpio %lu, fgpio %lu\r\n", gpio_bench(toggle_gpio), gpio_bench(toggle_fgpio));
+#endif
+#ifdef RAMFUNC_BENCH
+    LOG("Kernel cycles: flash %lu, ram %lu\r\n", ramfunc_bench(kernel_flash), ramfunc_bench(kernel_ram));
+#endif
 
-    uart_printf(UART_MSG, "System Clock: %lu\r\n", CORCLK);
-    uart_printf(UART_MSG, "Bus Clock: %lu\r\n", BUSCLK);
+    sched_create(&io_task, io_thread, NULL, io_stack, sizeof(io_stack) / 4, 2);
+#ifdef SCHED_BENCH
+    sched_create(&ping_task, ping_pong, &ping_task, ping_stack, sizeof(ping_stack) / 4, 1);
+    sched_create(&pong_task, ping_pong, NULL, pong_stack, sizeof(pong_stack) / 4, 1);
+#endif
+    sched_start();  // main() goes on as the idle task
+#ifdef ADC_DEMO
+    if (adc_init())
+        adc_start(ADC_DEMO_CHANNEL, ADC_DEMO_RATE, adc_block, NULL);
+    else
+        LOG("ADC calibration failed\r\n");
+#endif
 
-    uint32_t timer = 0;
+    swtimer_t status_timer = SWTIMER_INIT(status, NULL);
+    swtimer_start(&status_timer, 1000, 1000);
     for (;;) {
-        if (timer_expired(&timer, 1000)) {
-            uart_printf(UART_MSG, "UART RD: %d, tick: %lu\r\n", UART_MSG->S1 & UART_S1_RDRF_MASK ? 1 : 0, ms_ticks);
-        }
+        swtimer_poll();
+        log_flush(UART_MSG);
+        idle();
     }
 }
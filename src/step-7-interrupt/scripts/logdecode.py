@@ -0,0 +1,136 @@
+#!/usr/bin/env python3
+"""
+Decode the binary LOG() frames sent by log_flush back into text.
+Only for firmware built with make EXTRA_CFLAGS=-DLOG_DEFERRED, the default is plain text.
+
+    python3 scripts/logdecode.py build/firmware.elf /dev/ttyACM0
+    python3 scripts/logdecode.py build/firmware.elf capture.bin
+
+The serial port must already be configured, e.g. stty -F /dev/ttyACM0 9600 raw.
+Frames are COBS encoded and end with 0x00, the payload is
+id (2 bytes, little endian), argument count, one LEB128 varint per argument.
+The id is the offset of the format string in the .logstr section of the ELF.
+"""
+import re
+import struct
+import sys
+
+CONV = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d+))?(?:hh|h|ll|l|j|z|t)?([diouxXcp%])")
+
+
+def logstr_section(path):
+    with open(path, "rb") as f:
+        elf = f.read()
+    if elf[:4] != b"\x7fELF" or elf[4] != 1:
+        sys.exit("%s: not a 32-bit ELF file" % path)
+    shoff, = struct.unpack_from("<I", elf, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", elf, 0x2E)
+
+    def header(i):
+        # name, type, flags, addr, offset, size
+        return struct.unpack_from("<IIIIII", elf, shoff + i * shentsize)
+
+    names = header(shstrndx)[4]
+    for i in range(shnum):
+        name, _, _, _, offset, size = header(i)
+        if elf[names + name:elf.index(b"\0", names + name)] == b".logstr":
+            return elf[offset:offset + size]
+    sys.exit("%s: no .logstr section" % path)
+
+
+def cobs_decode(data):
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data) + 1:
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def varints(data, pos, n):
+    args = []
+    for _ in range(n):
+        v = shift = 0
+        while True:
+            if pos >= len(data):
+                return None
+            b = data[pos]
+            pos += 1
+            v |= (b & 0x7F) << shift
+            shift += 7
+            if b < 0x80:
+                break
+        args.append(v & 0xFFFFFFFF)
+    return args if pos == len(data) else None
+
+
+def render(format, args):
+    args = list(args)
+
+    def conv(m):
+        flags, width, prec, c = m.groups()
+        if c == "%":
+            return "%"
+        if width == "*":
+            width = str(args.pop(0))
+        if prec == "*":
+            prec = str(args.pop(0))
+        v = args.pop(0) if args else 0
+        if "#" in flags and (c == "o" or (c in "xX" and v == 0)):
+            # Python writes 0o17 and 0x0 where C writes 017 and 0: C's # for o only makes the first digit 0
+            flags = flags.replace("#", "")
+            if c == "o" and v != 0:
+                prec = str(max(int(prec or 0), len("%o" % v) + 1))
+        spec = "%" + flags + (width or "") + ("." + prec if prec else "")
+        if c in "di":
+            return (spec + "d") % (v - (1 << 32) if v & 0x80000000 else v)
+        if c == "u":
+            return (spec + "d") % v
+        if c == "c":
+            return (spec.replace("0", "") + "c") % chr(v & 0xFF)
+        if c == "p":
+            return (spec + "s") % ("0x%x" % v)
+        return (spec + c) % v
+
+    return CONV.sub(conv, format)
+
+
+def decode(strings, frame):
+    payload = cobs_decode(frame)
+    if payload is None or len(payload) < 3:
+        return "<bad frame %s>\n" % frame.hex()
+    id = payload[0] | payload[1] << 8
+    args = varints(payload, 3, payload[2])
+    if id >= len(strings) or args is None:
+        return "<bad frame %s>\n" % frame.hex()
+    format = strings[id:strings.index(b"\0", id)].decode("latin-1")
+    return render(format, args)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: logdecode.py firmware.elf (port | capture)")
+    strings = logstr_section(sys.argv[1])
+    frame = bytearray()
+    with open(sys.argv[2], "rb", buffering=0) as stream:
+        while True:
+            data = stream.read(64)
+            if not data:
+                break
+            for b in data:
+                if b != 0:
+                    frame.append(b)
+                    continue
+                if frame:
+                    sys.stdout.write(decode(strings, bytes(frame)).replace("\r", ""))
+                    sys.stdout.flush()
+                frame.clear()
+
+
+if __name__ == "__main__":
+    main()
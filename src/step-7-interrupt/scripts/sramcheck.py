@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""
+Report what the linker put in SRAM_L and SRAM_U and flag objects across the boundary.
+
+    python3 scripts/sramcheck.py build/firmware.elf.map
+
+SRAM_L is 0x1ffff000-0x1fffffff and SRAM_U 0x20000000-0x20002fff. An access that
+crosses 0x20000000 is split between the two arrays and cannot be a single transfer,
+so an object must sit entirely in one of them. Exit status 1 if one does not.
+"""
+import re
+import sys
+
+SRAM_L = 0x1FFFF000
+SRAM_U = 0x20000000
+SRAM_END = 0x20003000
+
+# " .bss.name  0x20000010  0x40 build/x.o", the name may be alone on the line before
+ENTRY = re.compile(r"^ (\.\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+(\S.*))?$")
+
+
+def sections(path):
+    with open(path) as f:
+        lines = f.read().split("\n")
+    try:
+        lines = lines[lines.index("Linker script and memory map"):]
+    except ValueError:
+        sys.exit("%s: not a GNU ld map file" % path)
+    name = None
+    for line in lines:
+        if re.match(r"^ \.\S+$", line):
+            name = line.strip()
+            continue
+        m = ENTRY.match(line)
+        if m and (m.group(1) or name):
+            yield m.group(1) or name, int(m.group(2), 16), int(m.group(3), 16), m.group(4) or ""
+        name = None
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: sramcheck.py firmware.elf.map")
+    used = {"SRAM_L": 0, "SRAM_U": 0}
+    bad = []
+    for name, addr, size, obj in sections(sys.argv[1]):
+        if size == 0 or addr + size <= SRAM_L or addr >= SRAM_END:
+            continue
+        if addr < SRAM_U < addr + size:
+            bad.append((name, addr, size, obj))
+        elif addr < SRAM_U:
+            used["SRAM_L"] += size
+        else:
+            used["SRAM_U"] += size
+    print("SRAM_L: %5d of %5d bytes" % (used["SRAM_L"], SRAM_U - SRAM_L))
+    print("SRAM_U: %5d of %5d bytes" % (used["SRAM_U"], SRAM_END - SRAM_U))
+    for name, addr, size, obj in bad:
+        print("straddles 0x%08x: %s 0x%08x+0x%x %s" % (SRAM_U, name, addr, size, obj))
+    sys.exit(1 if bad else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,112 @@
+#include "adc.h"
+
+#define ADC_GATES (SIM_SCGC6_PIT_MASK | SIM_SCGC6_ADC0_MASK)
+_Static_assert(BUSCLK / 2 / 4 <= 4000000u, "ADCK above 4 MHz for the calibration, raise ADIV");
+
+adc_stats_t adc_stats;
+
+static uint16_t adc_buf[2][ADC_BLOCK_SAMPLES] SRAM_U;  // Ping-pong, DMA destination
+static uint8_t filling;                               // Buffer the DMA writes now
+static volatile int8_t handed = -1;                   // Buffer the callback holds, -1 for none
+static adc_block_t adc_done;
+static void *adc_arg;
+
+static void adc_work_fn(void *arg);
+static work_t adc_work = WORK_INIT(adc_work_fn, NULL);
+
+// Bottom half: process the buffer adc_irq handed over, then give it back
+static void adc_work_fn(void *arg) {
+    (void)arg;
+    int8_t i = handed;
+    if (i < 0) return;
+    if (adc_done != NULL) adc_done(adc_buf[i], ADC_BLOCK_SAMPLES, adc_arg);
+    handed = -1;
+}
+
+/*
+    Point DMA_CH_ADC0 at buffer i. The ADC keeps its DMA request asserted until
+    the result is read, so a conversion finished meanwhile is picked up here.
+    CS: one 16-bit transfer per request, DINC: destination increment, D_REQ: stop at the end
+*/
+static void adc_dma_arm(uint8_t i) {
+    filling = i;
+    dma_arm(DMA_CH_ADC0, &ADC0->R[0], adc_buf[i], sizeof(adc_buf[i]),
+            DMA_DCR_ERQ_MASK | DMA_DCR_CS_MASK | DMA_DCR_D_REQ_MASK | DMA_DCR_DINC_MASK | DMA_DCR_SSIZE(DMA_SIZE_16) |
+                DMA_DCR_DSIZE(DMA_SIZE_16));
+}
+
+// Called from DMA2_IRQHandler: a buffer is full
+void adc_irq(void) {
+    uint32_t dsr = DMA0->DMA[DMA_CH_ADC0].DSR_BCR;
+    uint8_t full = filling;
+    if (dsr & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK | DMA_DSR_BCR_BED_MASK)) {
+        adc_stats.errors++;
+        adc_dma_arm(full);  // Start the block over
+        return;
+    }
+    if (handed == (full ^ 1)) {
+        adc_stats.dropped++;
+        adc_dma_arm(full);
+        return;
+    }
+    adc_dma_arm((uint8_t)(full ^ 1));
+    handed = (int8_t)full;
+    adc_stats.blocks++;
+    work_post(&adc_work);
+}
+
+/*
+    Calibrate ADC0 with 32 samples averaged and ADCK at most 4 MHz, as the reference
+    manual asks for, then switch to the sampling clock. Return false if the calibration failed (CALF).
+    ADICLK = 01: bus clock / 2 = 12 MHz, ADIV = 10: / 4 = 3 MHz for the calibration,
+    ADIV = 00: 12 MHz for sampling, MODE = 11: 16-bit single-ended
+*/
+bool adc_init(void) {
+    BME_OR(SIM->SCGC6, SIM_SCGC6_ADC0_MASK);
+    ADC0->CFG1 = ADC_CFG1_ADICLK(0x1) | ADC_CFG1_ADIV(0x2) | ADC_CFG1_MODE(0x3);
+    ADC0->SC2 = 0;
+    ADC0->SC3 = ADC_SC3_CAL_MASK | ADC_SC3_AVGE_MASK | ADC_SC3_AVGS(0x3);
+    while (ADC0->SC3 & ADC_SC3_CAL_MASK) asm("nop");
+    if (ADC0->SC3 & ADC_SC3_CALF_MASK) return false;
+
+    // Gains: half the sum of the calibration results with the MSB set
+    uint32_t sum = ADC0->CLP0 + ADC0->CLP1 + ADC0->CLP2 + ADC0->CLP3 + ADC0->CLP4 + ADC0->CLPS;
+    ADC0->PG = (sum >> 1) | 0x8000U;
+    sum = ADC0->CLM0 + ADC0->CLM1 + ADC0->CLM2 + ADC0->CLM3 + ADC0->CLM4 + ADC0->CLMS;
+    ADC0->MG = (sum >> 1) | 0x8000U;
+    ADC0->SC3 = 0;  // One conversion per trigger, no averaging
+    ADC0->CFG1 = ADC_CFG1_ADICLK(0x1) | ADC_CFG1_MODE(0x3);
+    return true;
+}
+
+void adc_start(uint8_t channel, uint32_t rate_hz, adc_block_t done, void *arg) {
+    adc_stop();
+    adc_done = done;
+    adc_arg = arg;
+    handed = -1;
+
+    BME_OR(SIM->SCGC6, ADC_GATES);
+
+    // DMA_CH_ADC0 reads R[0] on every ADC0 request, busy for idle until adc_stop
+    dma_claim(DMA_CH_ADC0);
+    adc_dma_arm(0);
+    dma_connect(DMA_CH_ADC0, DMA_SRC_ADC0);
+
+    // ADC0 triggered by PIT channel 0 (ADC0TRGSEL = 0100) into SC1A, result requests DMA
+    SIM->SOPT7 = SIM_SOPT7_ADC0ALTTRGEN_MASK | SIM_SOPT7_ADC0TRGSEL(0x4);
+    ADC0->SC2 = ADC_SC2_ADTRG_MASK | ADC_SC2_DMAEN_MASK;
+    ADC0->SC1[0] = ADC_SC1_ADCH(channel);
+
+    // PIT runs from the bus clock, one trigger every BUSCLK / rate_hz cycles
+    PIT->MCR = 0;
+    PIT->CHANNEL[0].LDVAL = BUSCLK / rate_hz - 1;
+    PIT->CHANNEL[0].TCTRL = PIT_TCTRL_TEN_MASK;
+}
+
+void adc_stop(void) {
+    if (!dma_busy(DMA_CH_ADC0)) return;  // Not sampling
+    PIT->CHANNEL[0].TCTRL = 0;
+    dma_stop(DMA_CH_ADC0);
+    ADC0->SC2 = 0;
+    ADC0->SC1[0] = ADC_SC1_ADCH(0x1F);  // Module disabled
+}
@@ -1,20 +1,35 @@
+#include "adc.h"
+#include "bme.h"
 #include "derivative.h"
+#include "dma.h"
 #include "uart.h"
-
-uint32_t CORCLK = CORCLK_DEFAULT;
-uint32_t BUSCLK = BUSCLK_DEFAULT;
+#include "sched.h"
+#include "wave.h"
 
 // ms count, volatile is important!!
-volatile uint32_t ms_ticks;
+volatile uint32_t ms_ticks SRAM_L;
+volatile uint32_t ms_ticks_hi SRAM_L;  // Wraps of ms_ticks, see time_ms in systick.h
+
+// The hot interrupts run from SRAM, no flash wait states on their path
+RAMFUNC void SysTick_Handler(void) {
+    if (++ms_ticks == 0) ms_ticks_hi++;
+    sched_tick();
+}
 
-void SysTick_Handler(void) { ms_ticks++; }
+RAMFUNC void UART1_IRQHandler(void) {
+    uart_rx_irq(UART1);
+    uart_tx_irq(UART1);
+}
 
-void UART1_IRQHandler(void) {
-    if (UART1->S1 & UART_S1_RDRF_MASK) {
-        char buf[64];
-        size_t len = uart_getline(UART1, buf);
-        uart_printf(UART_MSG, "%d: ", len);
-        uart_write_buf(UART_MSG, buf, len);
-        buf[0] = UART1->D;
-    }
+RAMFUNC void UART2_IRQHandler(void) {
+    uart_rx_irq(UART2);
+    uart_tx_irq(UART2);
 }
+
+// Tickless idle wake up, idle() reads and stops the timer itself
+void LPTMR0_IRQHandler(void) { BME_OR(LPTMR0->CSR, LPTMR_CSR_TCF_MASK); }
+
+void DMA0_IRQHandler(void) { dma_irq(0); }
+void DMA1_IRQHandler(void) { dma_irq(1); }
+void DMA2_IRQHandler(void) { adc_irq(); }   // DMA_CH_ADC0
+void DMA3_IRQHandler(void) { wave_irq(); }  // DMA_CH_WAVE
@@ -0,0 +1,18 @@
+#include "dma.h"
+
+static void dma_done(void *arg);
+
+dma_chan_t dma_chan[DMA_CHANNELS] = {
+    {NULL, NULL, false, false, WORK_INIT(dma_done, &dma_chan[0])},
+    {NULL, NULL, false, false, WORK_INIT(dma_done, &dma_chan[1])},
+    {NULL, NULL, false, false, WORK_INIT(dma_done, &dma_chan[2])},
+    {NULL, NULL, false, false, WORK_INIT(dma_done, &dma_chan[3])},
+};
+
+// Bottom half of dma_irq, skipped if dma_stop came first
+static void dma_done(void *arg) {
+    dma_chan_t *chan = (dma_chan_t *)arg;
+    if (!chan->active) return;
+    chan->active = false;
+    if (chan->callback != NULL) chan->callback((uint8_t)(chan - dma_chan), chan->error, chan->arg);
+}
@@ -0,0 +1,234 @@
+#include "format.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// Conversion flags
+#define FMT_LEFT 0x01U   // '-': left justify
+#define FMT_PLUS 0x02U   // '+': always print a sign
+#define FMT_SPACE 0x04U  // ' ': space in place of a plus sign
+#define FMT_ALT 0x08U    // '#': 0x prefix for hex, leading 0 for octal
+#define FMT_ZERO 0x10U   // '0': pad with zeros
+#define FMT_UPPER 0x20U  // 'X': upper case digits
+#define FMT_PTR 0x40U    // 'p': 0x prefix even for 0
+
+typedef struct {
+    fmt_putc_t putc;
+    void *arg;
+    size_t cnt;
+} fmt_out_t;
+
+static void out(fmt_out_t *o, char c) {
+    o->putc(c, o->arg);
+    o->cnt++;
+}
+
+static void pad(fmt_out_t *o, char c, int n) {
+    while (n-- > 0) out(o, c);
+}
+
+/*
+    Cortex-M0+ has no divide instruction and no 32x32->64 multiply, so v / 10 would
+    call __aeabi_uidivmod/__aeabi_uldivmod once per digit. Multiply by the reciprocal
+    instead: q = v * 0.8 is built from shifts and adds, q >> 3 is v / 10 or one less,
+    and the remainder fixes it up (Hacker's Delight, 10-17).
+*/
+static uint32_t divu10(uint32_t v, uint32_t *rem) {
+    uint32_t q = (v >> 1) + (v >> 2);
+    q += q >> 4;
+    q += q >> 8;
+    q += q >> 16;
+    q >>= 3;
+    uint32_t r = v - ((q << 3) + (q << 1));  // v - q * 10
+    if (r > 9) q++, r -= 10;
+    *rem = r;
+    return q;
+}
+
+static unsigned long long divu10_64(unsigned long long v, uint32_t *rem) {
+    unsigned long long q = (v >> 1) + (v >> 2);
+    q += q >> 4;
+    q += q >> 8;
+    q += q >> 16;
+    q += q >> 32;
+    q >>= 3;
+    unsigned long long r = v - ((q << 3) + (q << 1));
+    while (r > 9) q++, r -= 10;  // The 64-bit estimate can be short by more than one
+    *rem = (uint32_t)r;
+    return q;
+}
+
+static void put_uint(fmt_out_t *o, unsigned long long v, unsigned base, char sign, unsigned flags, int width,
+                     int prec) {
+    const char *hex = (flags & FMT_UPPER) ? "0123456789ABCDEF" : "0123456789abcdef";
+    char digits[22];  // 2^64 - 1 has 22 octal digits, digits are stored in reverse
+    int n = 0;
+    bool prefix_0x = ((flags & FMT_ALT) && base == 16 && v != 0) || (flags & FMT_PTR);
+
+    if (base == 10) {
+        uint32_t r;
+        for (; v > UINT32_MAX; digits[n++] = (char)('0' + r)) v = divu10_64(v, &r);
+        for (uint32_t w = (uint32_t)v; w != 0; digits[n++] = (char)('0' + r)) w = divu10(w, &r);
+    } else {
+        unsigned shift = base == 16 ? 4 : 3;  // Power-of-two bases only need shifts
+        for (; v != 0; v >>= shift) digits[n++] = hex[v & (base - 1)];
+    }
+
+    if (prec < 0)
+        prec = 1;
+    else
+        flags &= ~FMT_ZERO;  // '0' is ignored when a precision is given
+    int zeros = prec > n ? prec - n : 0;
+    if ((flags & FMT_ALT) && base == 8 && zeros == 0 && (n == 0 || digits[n - 1] != '0')) zeros = 1;
+
+    int len = (sign ? 1 : 0) + (prefix_0x ? 2 : 0) + zeros + n;
+    if (!(flags & (FMT_LEFT | FMT_ZERO))) pad(o, ' ', width - len);
+    if (sign) out(o, sign);
+    if (prefix_0x) out(o, '0'), out(o, (flags & FMT_UPPER) ? 'X' : 'x');
+    if ((flags & (FMT_LEFT | FMT_ZERO)) == FMT_ZERO) pad(o, '0', width - len);
+    pad(o, '0', zeros);
+    while (n > 0) out(o, digits[--n]);
+    if (flags & FMT_LEFT) pad(o, ' ', width - len);
+}
+
+static void put_str(fmt_out_t *o, const char *s, unsigned flags, int width, int prec) {
+    int len = 0;
+    if (s == NULL) s = "(null)";
+    while ((prec < 0 || len < prec) && s[len] != '\0') len++;
+    if (!(flags & FMT_LEFT)) pad(o, ' ', width - len);
+    for (int i = 0; i < len; i++) out(o, s[i]);
+    if (flags & FMT_LEFT) pad(o, ' ', width - len);
+}
+
+size_t fmt_vprintf(fmt_putc_t putc, void *arg, const char *format, va_list args) {
+    fmt_out_t o = {putc, arg, 0};
+    // Copy so the va_list can be passed to helpers by address on every ABI
+    va_list ap;
+    va_copy(ap, args);
+
+    for (const char *p = format; *p != '\0'; p++) {
+        if (*p != '%') {
+            out(&o, *p);
+            continue;
+        }
+
+        // Flags
+        unsigned flags = 0;
+        for (;; p++) {
+            if (p[1] == '-')
+                flags |= FMT_LEFT;
+            else if (p[1] == '+')
+                flags |= FMT_PLUS;
+            else if (p[1] == ' ')
+                flags |= FMT_SPACE;
+            else if (p[1] == '#')
+                flags |= FMT_ALT;
+            else if (p[1] == '0')
+                flags |= FMT_ZERO;
+            else
+                break;
+        }
+
+        // Width
+        int width = 0;
+        if (p[1] == '*') {
+            p++;
+            width = va_arg(ap, int);
+            if (width < 0) flags |= FMT_LEFT, width = -width;
+        } else
+            while (p[1] >= '0' && p[1] <= '9') width = width * 10 + (*++p - '0');
+
+        // Precision, negative means none
+        int prec = -1;
+        if (p[1] == '.') {
+            p++;
+            prec = 0;
+            if (p[1] == '*') {
+                p++;
+                prec = va_arg(ap, int);
+            } else
+                while (p[1] >= '0' && p[1] <= '9') prec = prec * 10 + (*++p - '0');
+        }
+
+        // Length modifier: number of 'l' (2 for ll, j), or -1/-2 for h/hh
+        int size = 0;
+        for (;; p++) {
+            if (p[1] == 'l' || p[1] == 'j')
+                size += p[1] == 'j' ? 2 : 1;
+            else if (p[1] == 'h')
+                size--;
+            else if (p[1] == 'z' || p[1] == 't')
+                size = sizeof(size_t) == sizeof(long) ? 1 : 0;
+            else
+                break;
+        }
+
+        unsigned long long v;
+        char sign = 0;
+        switch (*++p) {
+            case 'd':
+            case 'i': {
+                long long s;
+                if (size >= 2)
+                    s = va_arg(ap, long long);
+                else if (size == 1)
+                    s = va_arg(ap, long);
+                else
+                    s = va_arg(ap, int);
+                if (size == -1) s = (short)s;
+                if (size <= -2) s = (signed char)s;
+                v = s < 0 ? 0 - (unsigned long long)s : (unsigned long long)s;
+                sign = s < 0 ? '-' : (flags & FMT_PLUS) ? '+' : (flags & FMT_SPACE) ? ' ' : 0;
+                put_uint(&o, v, 10, sign, flags, width, prec);
+                break;
+            }
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                if (size >= 2)
+                    v = va_arg(ap, unsigned long long);
+                else if (size == 1)
+                    v = va_arg(ap, unsigned long);
+                else
+                    v = va_arg(ap, unsigned int);
+                if (size == -1) v = (unsigned short)v;
+                if (size <= -2) v = (unsigned char)v;
+                if (*p == 'X') flags |= FMT_UPPER;
+                put_uint(&o, v, *p == 'u' ? 10 : *p == 'o' ? 8 : 16, 0, flags, width, prec);
+                break;
+            case 'p':
+                v = (uintptr_t)va_arg(ap, void *);
+                put_uint(&o, v, 16, 0, flags | FMT_PTR, width, prec);
+                break;
+            case 'c': {
+                char c = (char)va_arg(ap, int);
+                if (!(flags & FMT_LEFT)) pad(&o, ' ', width - 1);
+                out(&o, c);
+                if (flags & FMT_LEFT) pad(&o, ' ', width - 1);
+                break;
+            }
+            case 's':
+                put_str(&o, va_arg(ap, const char *), flags, width, prec);
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                (void)va_arg(ap, double);  // No floating point support, skip the argument
+                break;
+            case '\0':  // Lone '%' at the end of the format
+                p--;
+                break;
+            default:  // "%%" and unknown conversions are printed as they are
+                out(&o, *p);
+                break;
+        }
+    }
+
+    va_end(ap);
+    return o.cnt;
+}
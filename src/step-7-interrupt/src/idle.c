@@ -0,0 +1,141 @@
+#include "idle.h"
+#include "bme.h"
+#include "dma.h"
+#include "log.h"
+#include "sched.h"
+#include "swtimer.h"
+#include "systick.h"
+#include "uart.h"
+
+idle_stats_t idle_stats;
+
+static bool deep_allowed;
+
+/*
+    deep: sleep in VLPS when nothing needs the bus clock. UART1/UART2 cannot wake
+    the core from VLPS, so bytes arriving during deep sleep are lost.
+*/
+void idle_init(bool deep) {
+    BME_OR(SIM->SCGC5, SIM_SCGC5_LPTMR_MASK);
+    LPTMR0->CSR = 0;
+    /*
+        PCS: Prescaler Clock Select, bits 0-1 of LPTMR_PSR, 01: LPO (1 kHz)
+        PBYP: Prescaler Bypass, the counter increments on every LPO cycle
+    */
+    LPTMR0->PSR = LPTMR_PSR_PCS(0x1) | LPTMR_PSR_PBYP_MASK;
+    NVIC_EnableIRQ(LPTMR0_IRQn);
+
+    SMC->PMPROT = SMC_PMPROT_AVLP_MASK;  // Allow very low power modes, write once after reset
+    deep_allowed = deep;
+}
+
+// A UART with its clock gated off counts as idle, its registers must not be touched
+static bool uart_idle(UART_Type *UART, uint32_t scgc4) {
+    return !(SIM->SCGC4 & scgc4) || (ring_empty(&uart_tx(UART)->ring) && (UART->S1 & UART_S1_TC_MASK));
+}
+
+// VLPS stops the bus clock, only enter it when no transfer is running
+static bool deep_ok(void) {
+    if (!deep_allowed) return false;
+    for (uint8_t ch = 0; ch < DMA_CHANNELS; ch++)
+        if (dma_busy(ch)) return false;
+    return uart_idle(UART1, SIM_SCGC4_UART1_MASK) && uart_idle(UART2, SIM_SCGC4_UART2_MASK);
+}
+
+// Leaving VLPS from PEE the MCG stays in PBE with the PLL relocking, switch back to the PLL
+static void pee_resume(void) {
+    if (!(MCG->C6 & MCG_C6_PLLS_MASK) || (MCG->S & MCG_S_CLKST_MASK) == MCG_S_CLKST(0x3)) return;
+    while (!(MCG->S & MCG_S_LOCK0_MASK)) asm("nop");
+    BME_AND(MCG->C1, ~MCG_C1_CLKS_MASK);
+    while ((MCG->S & MCG_S_CLKST_MASK) != MCG_S_CLKST(0x3)) asm("nop");
+}
+
+/*
+    Work an interrupt handed to the main loop after it last looked.
+    Queued log records only count once the TX ring is empty, until then TDRE wakes us.
+*/
+static bool work_pending(void) {
+    return !ring_empty(&uart1_rx.ring) || !ring_empty(&uart2_rx.ring) ||
+           (!ring_empty(&log_ring.ring) && ring_empty(&uart_tx(UART_MSG)->ring));
+}
+
+/*
+    Start the stopped SysTick again with phase cycles left of the current millisecond,
+    so the part of it that ran before the sleep is not lost. VAL cannot be written with
+    a value: any write clears it and the counter reloads from LOAD on the next clock,
+    so LOAD holds phase for that one reload and RELOAD again from the next wrap on.
+    Too close to the wrap to see the reload, a full millisecond starts instead.
+*/
+static void systick_restart(uint32_t phase) {
+    SysTick->LOAD = phase < IDLE_PHASE_MIN ? SYSTICK_RELOAD : phase;
+    SysTick->VAL = 0;
+    SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+    while (SysTick->VAL == 0) asm("nop");
+    SysTick->LOAD = SYSTICK_RELOAD;
+}
+
+/*
+    Called from the main loop when it has nothing to do. Sleep until the next
+    software timer is due, a task wakes up or an interrupt arrives. For more than one millisecond
+    SysTick is stopped and LPTMR0 counts instead. On wake up the whole milliseconds
+    LPTMR0 counted go to ms_ticks and SysTick goes on from the phase it stopped at.
+    A wake up within the first LPTMR0 period leaves SysTick as it was, the time slept
+    then is not counted, so the timebase can run slow but never backwards.
+*/
+void idle(void) {
+    __disable_irq();  // An interrupt arriving from here on still ends WFI
+    uint32_t ms = swtimer_idle_ticks();
+    uint32_t task_ms = sched_idle_ticks();
+    if (task_ms < ms) ms = task_ms;
+    if (ms == 0 || work_pending()) {
+        __enable_irq();
+        return;
+    }
+    if (ms == 1) {
+        __WFI();  // SysTick keeps running and wakes us
+        __enable_irq();
+        return;
+    }
+    if (ms > IDLE_MAX_MS) ms = IDLE_MAX_MS;
+
+    bool deep = deep_ok();
+    uint64_t before = time_cycles();
+    SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+    uint32_t phase = SysTick->VAL;  // Cycles left of the current millisecond
+
+    LPTMR0->CMR = ms - 1;  // TCF is set when CNR equals CMR and increments
+    LPTMR0->CSR = LPTMR_CSR_TIE_MASK | LPTMR_CSR_TEN_MASK;
+    if (deep) {
+        SMC->PMCTRL = SMC_PMCTRL_STOPM(0x2);  // STOPM = 010: VLPS
+        (void)SMC->PMCTRL;                    // Make sure the write completed before WFI
+        SCB->SCR |= SCB_SCR_SLEEPDEEP_Msk;
+    }
+    __DSB();
+    __WFI();
+    SCB->SCR &= ~SCB_SCR_SLEEPDEEP_Msk;
+    if (deep) pee_resume();
+
+    uint32_t slept;
+    if (LPTMR0->CSR & LPTMR_CSR_TCF_MASK)
+        slept = ms;
+    else {
+        LPTMR0->CNR = 0;  // Any write latches the counter for reading
+        slept = LPTMR0->CNR;
+    }
+    LPTMR0->CSR = 0;  // Also clears CNR and TCF
+    NVIC_ClearPendingIRQ(LPTMR0_IRQn);
+
+    if (slept > 0) {
+        uint32_t lo = ms_ticks;
+        ms_ticks = lo + slept;
+        if (ms_ticks < lo) ms_ticks_hi++;
+        systick_restart(phase);
+    } else
+        SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;  // VAL kept, counts on from where it stopped
+    if (time_cycles() < before) idle_stats.backwards++;
+
+    idle_stats.sleep_ms += slept;
+    idle_stats.sleeps++;
+    if (deep) idle_stats.deep++;
+    __enable_irq();  // The interrupt that woke us runs here
+}
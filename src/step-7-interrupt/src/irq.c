@@ -0,0 +1,30 @@
+#include "irq.h"
+
+extern void (*tab[IRQ_VECTORS])(void);  // Defined in src/startup.c
+
+// VTOR needs the table aligned to its size rounded up to a power of two, 48 words -> 256 bytes
+static irq_handler_t ram_tab[IRQ_VECTORS] __attribute__((aligned(256))) SRAM_L;
+
+bool irq_relocated(void) { return SCB->VTOR == (uint32_t)ram_tab; }
+
+// Copy the flash vector table to SRAM_L and switch to it, does nothing the second time
+void irq_relocate(void) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!irq_relocated()) {
+        for (size_t i = 0; i < IRQ_VECTORS; i++) ram_tab[i] = tab[i];
+        __DSB();
+        SCB->VTOR = (uint32_t)ram_tab;
+        __DSB();
+    }
+    __set_PRIMASK(primask);
+}
+
+// Install handler for irq, return the one it replaces, or NULL for an irq without a vector
+irq_handler_t irq_attach(IRQn_Type irq, irq_handler_t handler) {
+    if ((int)irq < (int)NonMaskableInt_IRQn || (int)irq >= IRQ_VECTORS - 16) return NULL;
+    irq_relocate();
+    irq_handler_t old = ram_tab[16 + irq];
+    ram_tab[16 + irq] = handler;
+    return old;
+}
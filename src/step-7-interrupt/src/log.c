@@ -0,0 +1,89 @@
+#include "log.h"
+#include <stdarg.h>
+
+static uint8_t log_buf[LOG_BUF_SIZE];
+
+log_ring_t log_ring = {RING_INIT(log_buf), 0};
+
+// LEB128: 7 bits per byte, small values take a single byte
+static size_t varint(uint8_t *p, uint32_t v) {
+    size_t n = 0;
+    while (v >= 0x80U) {
+        p[n++] = (uint8_t)(v | 0x80U);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+/*
+    Queue one record: length, id (little endian), argument count, varint arguments.
+    Arguments are read as 32-bit words, which is what int, long and pointers are on Cortex-M0+.
+*/
+void log_write(uint16_t id, unsigned nargs, ...) {
+    uint8_t rec[1 + LOG_RECORD_MAX];
+    size_t len = 1;
+    va_list ap;
+
+    if (nargs > LOG_ARGS_MAX) nargs = LOG_ARGS_MAX;
+    rec[len++] = (uint8_t)id;
+    rec[len++] = (uint8_t)(id >> 8);
+    rec[len++] = (uint8_t)nargs;
+    va_start(ap, nargs);
+    for (unsigned i = 0; i < nargs; i++) len += varint(&rec[len], va_arg(ap, uint32_t));
+    va_end(ap);
+    rec[0] = (uint8_t)(len - 1);
+
+    // ISRs and the main loop all produce, so a record is queued as a whole with interrupts masked
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (ring_space(&log_ring.ring) >= len)
+        for (size_t i = 0; i < len; i++) ring_put(&log_ring.ring, rec[i]);
+    else
+        log_ring.dropped++;
+    __set_PRIMASK(primask);
+}
+
+/*
+    COBS: replace every 0 in src by the distance to the next one, so 0 only appears
+    as the frame delimiter and the host can resynchronize anywhere in the stream.
+    dst needs len + 2 bytes, len must be below 254.
+*/
+static size_t cobs_encode(uint8_t *dst, const uint8_t *src, size_t len) {
+    size_t code_at = 0, n = 1;
+    uint8_t code = 1;
+    for (size_t i = 0; i < len; i++) {
+        if (src[i] == 0) {
+            dst[code_at] = code;
+            code_at = n++;
+            code = 1;
+        } else {
+            dst[n++] = src[i];
+            code++;
+        }
+    }
+    dst[code_at] = code;
+    dst[n++] = 0;
+    return n;
+}
+
+/*
+    Called from the main loop: move queued records to the UART as COBS frames,
+    stop as soon as the TX ring cannot take a whole frame. Return the number of frames sent.
+*/
+size_t log_flush(UART_Type *UART) {
+    uart_tx_t *tx = uart_tx(UART);
+    uint8_t rec[LOG_RECORD_MAX];
+    uint8_t frame[LOG_RECORD_MAX + 2];
+    uint8_t len;
+    size_t cnt = 0;
+
+    while (ring_peek(&log_ring.ring, &len)) {
+        if (tx != NULL && ring_space(&tx->ring) < (size_t)len + 2) break;
+        ring_skip(&log_ring.ring, 1);
+        for (size_t i = 0; i < len; i++) ring_get(&log_ring.ring, &rec[i]);
+        uart_write_buf(UART, (const char *)frame, cobs_encode(frame, rec, len));
+        cnt++;
+    }
+    return cnt;
+}
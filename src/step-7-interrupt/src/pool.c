@@ -0,0 +1,59 @@
+#include "pool.h"
+
+// Block storage, uint32_t for word alignment, collected into .pool by link.ld
+#define POOL_STORAGE __attribute__((section(".pool")))
+static uint32_t pool_small[POOL_SMALL_BLOCKS * 16 / 4] POOL_STORAGE;
+static uint32_t pool_medium[POOL_MEDIUM_BLOCKS * 64 / 4] POOL_STORAGE;
+static uint32_t pool_large[POOL_LARGE_BLOCKS * 256 / 4] POOL_STORAGE;
+
+pool_t pools[POOL_CLASSES] = {
+    POOL_INIT(pool_small, 16),
+    POOL_INIT(pool_medium, 64),
+    POOL_INIT(pool_large, 256),
+};
+
+// A block of p, or NULL (counted as a failure) if it has none left
+static void *pool_take(pool_t *p) {
+    void *block = NULL;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (p->free != NULL) {
+        block = p->free;
+        p->free = p->free->next;
+    } else if (p->fresh < p->end) {
+        block = p->fresh;
+        p->fresh += p->block_size;
+    }
+    if (block == NULL)
+        p->failures++;
+    else if (++p->used > p->peak)
+        p->peak = p->used;
+    __set_PRIMASK(primask);
+    return block;
+}
+
+// Falls back to the next larger class when one runs out, NULL if size is above every class
+void *pool_alloc(size_t size) {
+    for (size_t i = 0; i < POOL_CLASSES; i++) {
+        if (size > pools[i].block_size) continue;
+        void *block = pool_take(&pools[i]);
+        if (block != NULL) return block;
+    }
+    return NULL;
+}
+
+// block must come from pool_alloc, anything else is ignored
+void pool_free(void *block) {
+    if (block == NULL) return;
+    for (size_t i = 0; i < POOL_CLASSES; i++) {
+        pool_t *p = &pools[i];
+        if ((uint8_t *)block < p->start || (uint8_t *)block >= p->end) continue;
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        ((pool_block_t *)block)->next = p->free;
+        p->free = block;
+        p->used--;
+        __set_PRIMASK(primask);
+        return;
+    }
+}
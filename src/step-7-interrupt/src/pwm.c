@@ -0,0 +1,70 @@
+#include "pwm.h"
+#include "bme.h"
+#include "gpio.h"
+
+#define PWM_PS_MAX 7  // Prescaler 128
+
+// SCGC6 gate of TPM0/1/2
+static uint32_t pwm_gate(TPM_Type *tpm) { return SIM_SCGC6_TPM0_MASK << pwm_index(tpm); }
+
+// Counter clock after the prescaler of a running TPM
+static uint32_t pwm_clock(TPM_Type *tpm) { return TPMCLK >> (tpm->SC & TPM_SC_PS_MASK); }
+
+/*
+    SC and CnSC live in the TPM counter clock domain, a write takes effect a few
+    counter clocks later. Mode changes must go through 0 and wait for it to read back.
+*/
+static void pwm_stop(TPM_Type *tpm) {
+    tpm->SC = 0;
+    while (tpm->SC & TPM_SC_CMOD_MASK) asm("nop");
+}
+
+uint32_t pwm_init(TPM_Type *tpm, uint32_t freq_hz, uint32_t steps) {
+    if (freq_hz == 0) return 0;
+    uint32_t ps = PWM_PS_MAX;
+    uint32_t counts = (TPMCLK >> ps) / freq_hz;
+    while (counts < steps && ps > 0) counts = (TPMCLK >> --ps) / freq_hz;
+    if (counts < steps || counts < 2 || counts > PWM_COUNTS_MAX) return 0;
+
+    BME_OR(SIM->SCGC6, pwm_gate(tpm));
+    BME_BFI(SIM->SOPT2, SIM_SOPT2_TPMSRC_SHIFT, 2, SIM_SOPT2_TPMSRC(0x1));
+    pwm_stop(tpm);
+    tpm->CNT = 0;
+    tpm->MOD = counts - 1;
+    tpm->SC = TPM_SC_CMOD(0x1) | TPM_SC_PS(ps);  // Count up on every TPM counter clock
+    return counts;
+}
+
+/*
+    Give pin (GPIO_PIN numbering) to channel ch at port mux alt, starting inactive.
+    MSB:ELSB: high-true pulses, set at reload, clear at CnV
+    MSB:ELSA: low-true pulses, clear at reload, set at CnV, for active low loads such as the RGB LED
+*/
+void pwm_channel(TPM_Type *tpm, uint8_t ch, uint8_t pin, uint8_t alt, bool active_low) {
+    uint32_t cnsc = TPM_CnSC_MSB_MASK | (active_low ? TPM_CnSC_ELSA_MASK : TPM_CnSC_ELSB_MASK);
+    tpm->CONTROLS[ch].CnSC = 0;
+    while (tpm->CONTROLS[ch].CnSC & (TPM_CnSC_MSB_MASK | TPM_CnSC_ELSA_MASK | TPM_CnSC_ELSB_MASK)) asm("nop");
+    tpm->CONTROLS[ch].CnV = 0;
+    tpm->CONTROLS[ch].CnSC = cnsc;
+    while ((tpm->CONTROLS[ch].CnSC & cnsc) != cnsc) asm("nop");
+
+    BME_OR(SIM->SCGC5, SIM_SCGC5_PORTA_MASK << (pin >> 5));
+    gpio_port(pin)->PCR[pin & 31] = PORT_PCR_MUX(alt);
+}
+
+/*
+    Square wave at freq_hz on channel ch, 0 for silence. Rewrites MOD, so the TPM
+    is the tone's own; the new period and duty are latched together at the next wrap.
+    One division, the range is set by the prescaler pwm_init picked: pass the lowest tone.
+*/
+void pwm_tone(TPM_Type *tpm, uint8_t ch, uint32_t freq_hz) {
+    if (freq_hz == 0) {
+        pwm_write(tpm, ch, 0);
+        return;
+    }
+    uint32_t counts = pwm_clock(tpm) / freq_hz;
+    if (counts < 2) counts = 2;
+    if (counts > PWM_COUNTS_MAX) counts = PWM_COUNTS_MAX;
+    tpm->MOD = counts - 1;
+    pwm_write(tpm, ch, counts / 2);
+}
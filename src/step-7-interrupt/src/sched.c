@@ -0,0 +1,173 @@
+#include "sched.h"
+#include "work.h"
+
+sched_task_t *volatile sched_cur;
+sched_task_t *volatile sched_next;
+sched_stats_t sched_stats;
+
+static sched_task_t idle_task;  // main() after sched_start
+static sched_task_t *tasks[SCHED_TASKS] = {&idle_task};
+static size_t ntasks = 1;
+static uint32_t slice;         // Milliseconds the current task has run
+static volatile bool rotate;  // Let the next task of the same priority run
+static uint64_t msp_stack[SCHED_MSP_WORDS / 2] SRAM_L;  // uint64_t for 8-byte alignment
+
+// A task function returned: park the task forever
+static void task_exit(void) {
+    sched_cur->state = SCHED_DONE;
+    for (;;) sched_yield();
+}
+
+void sched_yield(void) {
+    rotate = true;
+    SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+    __DSB();
+    __ISB();
+}
+
+// Return false if all SCHED_TASKS slots are taken
+bool sched_create(sched_task_t *t, sched_fn_t fn, void *arg, uint32_t *stack, size_t words, uint8_t prio) {
+    /*
+        Initial stack: the exception frame PendSV_Handler returns through
+        (r0-r3, r12, lr, pc, xPSR) and below it r4-r11 as saved by the switch.
+    */
+    uint32_t *sp = stack + words - 16;
+    for (int i = 0; i < 16; i++) sp[i] = 0;
+    sp[8] = (uint32_t)(uintptr_t)arg;         // r0
+    sp[13] = (uint32_t)(uintptr_t)task_exit;  // lr
+    sp[14] = (uint32_t)(uintptr_t)fn & ~1UL;  // pc, the Thumb bit must be clear in the frame
+    sp[15] = 0x01000000UL;                    // xPSR, Thumb bit set
+    t->sp = sp;
+    t->prio = prio;
+    t->wake = 0;
+    t->state = SCHED_READY;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    bool added = ntasks < SCHED_TASKS;
+    if (added) tasks[ntasks++] = t;
+    __set_PRIMASK(primask);
+    if (added && sched_running()) SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;  // Preempt if it has a higher priority
+    return added;
+}
+
+void sched_start(void) {
+    // Keep running on the same stack, but as PSP, and give handlers a fresh MSP
+    __set_PSP(__get_MSP());
+    __set_CONTROL(0x2);  // SPSEL: thread mode uses PSP
+    __ISB();
+    __set_MSP((uint32_t)(uintptr_t)&msp_stack[SCHED_MSP_WORDS / 2]);
+    idle_task.state = SCHED_READY;
+    sched_cur = &idle_task;
+    sched_yield();
+}
+
+// Put the calling task to sleep, the idle task never sleeps
+void sched_sleep(uint32_t ms) {
+    if (!sched_running() || sched_cur == &idle_task) return;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    sched_cur->wake = ms_ticks + ms;
+    sched_cur->state = SCHED_SLEEPING;
+    __set_PRIMASK(primask);
+    sched_yield();
+}
+
+// Called from SysTick_Handler: wake sleepers and end time slices
+void sched_tick(void) {
+    if (!sched_running()) return;
+    bool pend = false;
+    if (++slice >= SCHED_SLICE_MS) rotate = pend = true;
+    for (size_t i = 1; i < ntasks; i++) {
+        if (tasks[i]->state == SCHED_SLEEPING && (int32_t)(ms_ticks - tasks[i]->wake) >= 0) {
+            tasks[i]->state = SCHED_READY;
+            pend = true;
+        }
+    }
+    if (pend) SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+// Milliseconds until a sleeping task wakes, UINT32_MAX if none sleeps
+uint32_t sched_idle_ticks(void) {
+    uint32_t next = UINT32_MAX;
+    for (size_t i = 1; i < ntasks; i++) {
+        int32_t left = (int32_t)(tasks[i]->wake - ms_ticks);
+        if (tasks[i]->state == SCHED_READY) return 0;
+        if (tasks[i]->state == SCHED_SLEEPING && (uint32_t)(left < 0 ? 0 : left) < next)
+            next = (uint32_t)(left < 0 ? 0 : left);
+    }
+    return next;
+}
+
+/*
+    Called from PendSV_Handler: choose the highest priority ready task.
+    Once the time slice is over or the task yielded, the search starts after the
+    current task and another ready task of the same priority gets its turn.
+    Return true if sched_next differs from sched_cur.
+*/
+bool sched_pick(void) {
+    if (!sched_running()) return false;
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    size_t i = 0;
+    while (tasks[i] != sched_cur) i++;
+    sched_task_t *best = sched_cur->state == SCHED_READY ? sched_cur : &idle_task;
+    for (size_t n = 1; n < ntasks; n++) {
+        if (++i == ntasks) i = 0;
+        sched_task_t *t = tasks[i];
+        if (t->state != SCHED_READY) continue;
+        if (t->prio > best->prio || (t->prio == best->prio && best == sched_cur && rotate)) best = t;
+    }
+    if (best != sched_cur || rotate) slice = 0;
+    rotate = false;
+    sched_next = best;
+    __set_PRIMASK(primask);
+    if (best == sched_cur) return false;
+    sched_stats.switches++;
+    return true;
+}
+
+/*
+    Run the bottom halves, then switch tasks if sched_pick asks for it.
+    Hardware already stacked r0-r3, r12, lr, pc and xPSR on the PSP, r4-r11 are
+    stored below them. Cortex-M0+ can only STM/LDM r0-r7, so r8-r11 go through r4-r7.
+*/
+__attribute__((naked)) void PendSV_Handler(void) {
+    __asm volatile(
+        "push {r4, lr}\n"  // r4 keeps the stack 8-byte aligned, work_run preserves it
+        "bl work_run\n"
+        "bl sched_pick\n"
+        "pop {r1, r2}\n"
+        "mov lr, r2\n"
+        "cmp r0, #0\n"
+        "beq 1f\n"
+
+        "mrs r0, psp\n"
+        "subs r0, #32\n"
+        "ldr r3, =sched_cur\n"
+        "ldr r2, [r3]\n"
+        "str r0, [r2]\n"  // sched_cur->sp
+        "stmia r0!, {r4-r7}\n"
+        "mov r4, r8\n"
+        "mov r5, r9\n"
+        "mov r6, r10\n"
+        "mov r7, r11\n"
+        "stmia r0!, {r4-r7}\n"
+
+        "ldr r2, =sched_next\n"
+        "ldr r2, [r2]\n"
+        "str r2, [r3]\n"  // sched_cur = sched_next
+        "ldr r0, [r2]\n"
+        "adds r0, #16\n"
+        "ldmia r0!, {r4-r7}\n"
+        "mov r8, r4\n"
+        "mov r9, r5\n"
+        "mov r10, r6\n"
+        "mov r11, r7\n"
+        "msr psp, r0\n"
+        "subs r0, #32\n"
+        "ldmia r0!, {r4-r7}\n"
+        "1:\n"
+        "bx lr\n"
+        ".ltorg\n");
+}
@@ -1,4 +1,6 @@
+#include "bme.h"
 #include "derivative.h"
+#include <stdbool.h>
 #include <string.h>
 
 extern int main(void);  // Defined in main.c
@@ -8,19 +10,107 @@ static void __init_hardware() {
     SIM->COPC = 0x0;
 }
 
+#ifndef BOOT_MEMSET
+/*
+    link.ld aligns the start and end of .ramfunc, .sram_l, .data, .bss and load images to 16 bytes,
+    so both loops move four words per LDM/STM (1 + 4 cycles each) and need no tail.
+    r2-r5 are free scratch registers this early, the loop counters stay in other low registers.
+*/
+static void zero_words(uint32_t *dst, const uint32_t *end) {
+    __asm volatile(
+        "movs r2, #0\n"
+        "movs r3, #0\n"
+        "movs r4, #0\n"
+        "movs r5, #0\n"
+        "1:\n"
+        "cmp %[dst], %[end]\n"
+        "bhs 2f\n"
+        "stmia %[dst]!, {r2, r3, r4, r5}\n"
+        "b 1b\n"
+        "2:\n"
+        : [dst] "+l"(dst)
+        : [end] "l"(end)
+        : "r2", "r3", "r4", "r5", "cc", "memory");
+}
+
+static void copy_words(uint32_t *dst, const uint32_t *src, const uint32_t *end) {
+    __asm volatile(
+        "1:\n"
+        "cmp %[dst], %[end]\n"
+        "bhs 2f\n"
+        "ldmia %[src]!, {r2, r3, r4, r5}\n"
+        "stmia %[dst]!, {r2, r3, r4, r5}\n"
+        "b 1b\n"
+        "2:\n"
+        : [dst] "+l"(dst), [src] "+l"(src)
+        : [end] "l"(end)
+        : "r2", "r3", "r4", "r5", "cc", "memory");
+}
+#else
+// newlib memset/memcpy, only kept to compare boot time (EXTRA_CFLAGS=-DBOOT_MEMSET)
+static void zero_words(uint32_t *dst, const uint32_t *end) {
+    memset(dst, 0, (size_t)((const char *)end - (const char *)dst));
+}
+
+static void copy_words(uint32_t *dst, const uint32_t *src, const uint32_t *end) {
+    memcpy(dst, src, (size_t)((const char *)end - (const char *)dst));
+}
+#endif
+
+// .bss in SRAM_U and the SRAM_L variables
 static void zero_fill_bss(void) {
-    extern char _sbss[];
-    extern char _ebss[];
-    memset(_sbss, 0, (size_t)(_ebss - _sbss));
+    extern uint32_t _sbss[];
+    extern uint32_t _ebss[];
+    extern uint32_t _ssram_l[];
+    extern uint32_t _esram_l[];
+    zero_words(_sbss, _ebss);
+    zero_words(_ssram_l, _esram_l);
 }
 
+// RAMFUNC code and initialized variables, from their load images in flash
 static void copy_data(void) {
-    extern char _sdata[];
-    extern char _edata[];
-    extern char _sidata[];
-    memcpy(_sdata, _sidata, (size_t)(_edata - _sdata));
+    extern uint32_t _sramfunc[];
+    extern uint32_t _eramfunc[];
+    extern uint32_t _siramfunc[];
+    extern uint32_t _sdata[];
+    extern uint32_t _edata[];
+    extern uint32_t _sidata[];
+    copy_words(_sramfunc, _siramfunc, _eramfunc);
+    copy_words(_sdata, _sidata, _edata);
 }
 
+#ifdef BOOT_BENCH_BYTES
+// Grow .data and .bss to see how the startup copy scales
+static uint8_t boot_bench_data[BOOT_BENCH_BYTES] = {1};
+static uint8_t boot_bench_bss[BOOT_BENCH_BYTES];
+#endif
+
+uint32_t boot_cycles;  // Core clock cycles from _reset to main
+
+// Let SysTick count core clock cycles from reset, main reprograms it with SysTick_Config
+static void boot_timer_start(void) {
+    SysTick->LOAD = SysTick_LOAD_RELOAD_Msk;
+    SysTick->VAL = 0;
+    SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+// Called after .bss is cleared, right before main
+static void boot_timer_stop(void) {
+    boot_cycles = SysTick_LOAD_RELOAD_Msk - SysTick->VAL;
+#ifdef BOOT_BENCH_BYTES
+    boot_bench_bss[0] = boot_bench_data[0];  // Keep both arrays from --gc-sections
+#endif
+}
+
+#ifdef CLOCK_VERIFY
+/*
+    Runtime clock decoder, only built with -DCLOCK_VERIFY. CORCLK and BUSCLK are
+    compile-time constants in derivative.h, this reads the MCG back after pll_init
+    so main can check that the hardware really runs at those rates.
+*/
+uint32_t clock_decoded_core;
+uint32_t clock_decoded_bus;
+
 static uint32_t MCGOUTClock;
 static uint16_t Divider;
 
@@ -126,7 +216,73 @@ static void inter_clock(void) {
 }
 
 static void exter_clock(void) { MCGOUTClock = CPU_XTAL_CLK_HZ; }
+#endif
+
+#define MCG_TIMEOUT 100000U  // Polls of an MCG status flag before giving up
+
+// Wait until (MCG->S & mask) == value, return false on timeout
+static bool mcg_wait(uint8_t mask, uint8_t value) {
+    for (uint32_t i = 0; i < MCG_TIMEOUT; i++)
+        if ((MCG->S & mask) == value) return true;
+    return false;
+}
+
+/*
+    Move the MCG from FEI (reset default, 20.97 MHz FLL) to PEE with the clock tree
+    of derivative.h: CPU_XTAL_CLK_HZ / CLOCK_PRDIV * CLOCK_VDIV = PLLCLK,
+    CORCLK = PLLCLK / CLOCK_OUTDIV1, BUSCLK = CORCLK / CLOCK_OUTDIV4.
+    Return false if a step timed out.
+*/
+static bool pee_enter(void) {
+    // EXTAL0/XTAL0 (PTA18/PTA19) on their default analog function for the crystal
+    BME_OR(SIM->SCGC5, SIM_SCGC5_PORTA_MASK);
+    PORTA->PCR[18] = PORT_PCR_MUX(0x0);
+    PORTA->PCR[19] = PORT_PCR_MUX(0x0);
+
+    // Dividers first, so no clock is ever above its limit during the switch
+    SIM->CLKDIV1 = SIM_CLKDIV1_OUTDIV1(CLOCK_OUTDIV1 - 1) | SIM_CLKDIV1_OUTDIV4(CLOCK_OUTDIV4 - 1);
+
+    /*
+        FEI -> FBE: external reference on MCGOUTCLK, FLL still running from it
+        RANGE0 = 01: high frequency crystal, EREFS0: oscillator requested
+        CLKS = 10: external reference, FRDIV: crystal / (32 << FRDIV) for the FLL, IREFS = 0
+    */
+    MCG->C2 = MCG_C2_RANGE0(0x1) | MCG_C2_EREFS0_MASK;
+    MCG->C1 = MCG_C1_CLKS(0x2) | MCG_C1_FRDIV(CLOCK_FRDIV);
+    if (!mcg_wait(MCG_S_OSCINIT0_MASK, MCG_S_OSCINIT0_MASK)) return false;
+    if (!mcg_wait(MCG_S_IREFST_MASK, 0)) return false;
+    if (!mcg_wait(MCG_S_CLKST_MASK, MCG_S_CLKST(0x2))) return false;
+
+    // FBE -> PBE: PLL selected and locked while MCGOUTCLK still comes from the crystal
+    MCG->C5 = MCG_C5_PRDIV0(CLOCK_PRDIV - 1);
+    MCG->C6 = MCG_C6_PLLS_MASK | MCG_C6_VDIV0(CLOCK_VDIV - 24);
+    if (!mcg_wait(MCG_S_PLLST_MASK, MCG_S_PLLST_MASK)) return false;
+    if (!mcg_wait(MCG_S_LOCK0_MASK, MCG_S_LOCK0_MASK)) return false;
+
+    // PBE -> PEE: PLL on MCGOUTCLK
+    BME_AND(MCG->C1, ~MCG_C1_CLKS_MASK);
+    return mcg_wait(MCG_S_CLKST_MASK, MCG_S_CLKST(0x3));
+}
+
+/*
+    Run from the PLL, or go back to FEI and the default clocks if the crystal or the PLL fails.
+    In that case the core runs at CORCLK_DEFAULT instead of CORCLK and every rate derived
+    at compile time is off; a -DCLOCK_VERIFY build reports it.
+*/
+static void pll_init(void) {
+    if (pee_enter()) {
+        // MCGPLLCLK / 2 for the peripherals with a selectable clock (TPM, UART0, USB)
+        BME_OR(SIM->SOPT2, SIM_SOPT2_PLLFLLSEL_MASK);
+        return;
+    }
+    MCG->C6 = 0;
+    MCG->C1 = MCG_C1_IREFS_MASK;  // FEI: FLL on the slow internal reference
+    MCG->C2 = 0;
+    mcg_wait(MCG_S_CLKST_MASK | MCG_S_IREFST_MASK, MCG_S_IREFST_MASK);
+    SIM->CLKDIV1 = SIM_CLKDIV1_OUTDIV1(0x0) | SIM_CLKDIV1_OUTDIV4(0x1);
+}
 
+#ifdef CLOCK_VERIFY
 static void clock_init(void) {
     /*
         CLKS: Clock Source Select, bits 6-7 of MCG_C1
@@ -154,17 +310,23 @@ static void clock_init(void) {
     else if ((MCG->C1 & MCG_C1_CLKS_MASK) == 0x80U)
         exter_clock();
 
-    CORCLK = (MCGOUTClock / (0x01U + ((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT)));
-    CORCLK = (uint32_t)(CORCLK / 1000U) * 1000U;
-    BUSCLK = CORCLK / (0x01U + ((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV4_MASK) >> SIM_CLKDIV1_OUTDIV4_SHIFT));
-    BUSCLK = (uint32_t)(BUSCLK / 1000U) * 1000U;
+    uint32_t core = MCGOUTClock / (0x01U + ((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV1_MASK) >> SIM_CLKDIV1_OUTDIV1_SHIFT));
+    uint32_t bus = core / (0x01U + ((SIM->CLKDIV1 & SIM_CLKDIV1_OUTDIV4_MASK) >> SIM_CLKDIV1_OUTDIV4_SHIFT));
+    clock_decoded_core = (uint32_t)(core / 1000U) * 1000U;
+    clock_decoded_bus = (uint32_t)(bus / 1000U) * 1000U;
 }
+#endif
 
 __attribute__((naked, noreturn)) void _reset(void) {
+    boot_timer_start();
     __init_hardware();
     zero_fill_bss();
     copy_data();
+    pll_init();
+#ifdef CLOCK_VERIFY
     clock_init();
+#endif
+    boot_timer_stop();
 
     main();
     for (;;) (void)0;
@@ -0,0 +1,139 @@
+#include "swtimer.h"
+#include "systick.h"
+
+#define SLOT_MASK (SWTIMER_SLOTS - 1U)
+
+static swtimer_t *wheel[SWTIMER_LEVELS][SWTIMER_SLOTS];
+static uint32_t base;   // Next tick to process
+static size_t pending;  // Number of running timers
+
+static void slot_add(swtimer_t **head, swtimer_t *t) {
+    t->next = *head;
+    if (t->next != NULL) t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+}
+
+static void slot_del(swtimer_t *t) {
+    *t->pprev = t->next;
+    if (t->next != NULL) t->next->pprev = t->pprev;
+    t->pprev = NULL;
+}
+
+/*
+    Level n holds the timers due within SWTIMER_SLOTS^(n + 1) ticks, in the slot
+    given by bits n * SLOT_BITS of the expiry time. Timers further away than the
+    last level are parked at its far end and placed again when they cascade down.
+*/
+static void place(swtimer_t *t) {
+    int32_t delta = (int32_t)(t->expires - base);
+    uint32_t at = delta < 0 ? base : t->expires;  // Overdue: run on the next processed tick
+    int level = 0;
+
+    while (level < SWTIMER_LEVELS - 1 && delta >= (int32_t)(1UL << (SWTIMER_SLOT_BITS * (level + 1)))) level++;
+    if (delta >= (int32_t)(1UL << (SWTIMER_SLOT_BITS * SWTIMER_LEVELS)))
+        at = base + (1UL << (SWTIMER_SLOT_BITS * SWTIMER_LEVELS)) - 1;
+    slot_add(&wheel[level][(at >> (SWTIMER_SLOT_BITS * level)) & SLOT_MASK], t);
+}
+
+void swtimer_start(swtimer_t *t, uint32_t delay, uint32_t period) {
+    if (swtimer_active(t))
+        slot_del(t);
+    else if (pending++ == 0)
+        base = ms_ticks;  // Wheel was idle, skip the ticks nobody waited for
+    t->expires = ms_ticks + delay;
+    t->period = period;
+    place(t);
+}
+
+void swtimer_stop(swtimer_t *t) {
+    if (!swtimer_active(t)) return;
+    slot_del(t);
+    pending--;
+}
+
+// Move every timer of one slot to a lower level
+static void cascade(int level) {
+    swtimer_t **head = &wheel[level][(base >> (SWTIMER_SLOT_BITS * level)) & SLOT_MASK];
+    while (*head != NULL) {
+        swtimer_t *t = *head;
+        slot_del(t);
+        place(t);
+    }
+}
+
+/*
+    Ticks from base to the first tick that processes a non-empty slot, either firing
+    level 0 or cascading a higher level, UINT32_MAX if the whole wheel is empty.
+*/
+static uint32_t next_busy(void) {
+    uint32_t next = UINT32_MAX;
+    for (int level = 0; level < SWTIMER_LEVELS; level++) {
+        uint32_t step = 1UL << (SWTIMER_SLOT_BITS * level);
+        uint32_t at = (base + step - 1) & ~(step - 1);  // First tick that processes a slot of this level
+        for (uint32_t k = 0; k < SWTIMER_SLOTS && at - base < next; k++, at += step) {
+            if (wheel[level][(at >> (SWTIMER_SLOT_BITS * level)) & SLOT_MASK] != NULL) {
+                next = at - base;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+size_t swtimer_poll(void) {
+    size_t cnt = 0;
+    swtimer_t *expired;
+
+    while (pending > 0 && (int32_t)(ms_ticks - base) >= 0) {
+        // Jump over empty slots, after a long sleep straight to the next busy tick or past ms_ticks
+        uint32_t now = ms_ticks;
+        uint32_t skip = next_busy();
+        if (skip > now - base) {
+            base = now + 1;
+            break;
+        }
+        base += skip;
+
+        // Entering a new round of a level refills it from the level above
+        for (int level = 1; level < SWTIMER_LEVELS; level++) {
+            if ((base >> (SWTIMER_SLOT_BITS * (level - 1))) & SLOT_MASK) break;
+            cascade(level);
+        }
+
+        // Detach the slot first, callbacks may start, stop or restart timers
+        expired = NULL;
+        swtimer_t **slot = &wheel[0][base & SLOT_MASK];
+        if (*slot != NULL) {
+            expired = *slot;
+            expired->pprev = &expired;
+            *slot = NULL;
+        }
+        base++;
+
+        while (expired != NULL) {
+            swtimer_t *t = expired;
+            slot_del(t);
+            if (t->period != 0) {
+                t->expires += t->period;
+                place(t);
+            } else
+                pending--;
+            t->callback(t->arg);
+            cnt++;
+        }
+    }
+    return cnt;
+}
+
+/*
+    Milliseconds that can pass before swtimer_poll has something to do, UINT32_MAX
+    without running timers. A timer in a higher level counts from the tick its slot
+    cascades, so the result may be shorter than the real deadline, never longer.
+*/
+uint32_t swtimer_idle_ticks(void) {
+    if (pending == 0) return UINT32_MAX;
+    if ((int32_t)(ms_ticks - base) >= 0) return 0;  // Ticks waiting for swtimer_poll
+    uint32_t next = next_busy();
+    return next == UINT32_MAX ? UINT32_MAX : next + base - ms_ticks;
+}
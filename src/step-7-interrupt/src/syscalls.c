@@ -1,12 +1,31 @@
+#include "heap.h"
+#include <errno.h>
+#include <stddef.h>
 #include <sys/types.h>
 
 extern char _end;
+extern char _heap_limit;  // Defined in link.ld, a guard gap below the stack
 
+heap_stats_t heap_stats;
+
+/*
+    The heap grows from _end up to _heap_limit and never into the stack reserved above it.
+    A request that does not fit fails with ENOMEM, malloc then returns NULL.
+*/
 void *_sbrk(int incr) {
-    static unsigned char *heap = NULL;
-    unsigned char *prev_heap;
-    if (heap == NULL) heap = (unsigned char *)&_end;
-    prev_heap = heap;
+    static char *heap = NULL;
+    if (heap == NULL) {
+        heap = &_end;
+        heap_stats.size = (uint32_t)(&_heap_limit - &_end);
+    }
+    if (incr > &_heap_limit - heap || incr < &_end - heap) {
+        heap_stats.failures++;
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+    char *prev_heap = heap;
     heap += incr;
+    heap_stats.current = (uint32_t)(heap - &_end);
+    if (heap_stats.current > heap_stats.peak) heap_stats.peak = heap_stats.current;
     return prev_heap;
 }
@@ -0,0 +1,21 @@
+#include "uart.h"
+
+static uint8_t uart1_tx_buf[UART_TX_BUF_SIZE];
+static uint8_t uart2_tx_buf[UART_TX_BUF_SIZE];
+static uint8_t uart1_rx_buf[UART_RX_BUF_SIZE];
+static uint8_t uart2_rx_buf[UART_RX_BUF_SIZE];
+
+uart_tx_t uart1_tx = {RING_INIT(uart1_tx_buf), UART_TX_BLOCK, NULL, NULL};
+uart_tx_t uart2_tx = {RING_INIT(uart2_tx_buf), UART_TX_BLOCK, NULL, NULL};
+uart_rx_t uart1_rx = {RING_INIT(uart1_rx_buf), 0};
+uart_rx_t uart2_rx = {RING_INIT(uart2_rx_buf), 0};
+
+// DMA completion of uart_write_dma: hand TDRE back to the TX ring interrupt
+void uart_dma_done(uint8_t ch, bool error, void *arg) {
+    UART_Type *UART = (UART_Type *)arg;
+    uart_tx_t *tx = uart_tx(UART);
+    BME_AND(UART->C2, ~UART_C2_TIE_MASK);
+    BME_AND(UART->C4, ~UART_C4_TDMAS_MASK);
+    if (!ring_empty(&tx->ring)) BME_OR(UART->C2, UART_C2_TIE_MASK);  // Bytes queued meanwhile
+    if (tx->dma_done != NULL) tx->dma_done(ch, error, tx->dma_arg);
+}
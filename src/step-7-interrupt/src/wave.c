@@ -0,0 +1,123 @@
+#include "wave.h"
+#include "bme.h"
+
+wave_stats_t wave_stats;
+
+static TPM_Type *wave_tpm;           // NULL when stopped
+static volatile uint32_t *wave_reg;  // CnV or MOD of wave_tpm, DMA destination
+static const uint16_t *playing;      // Table the DMA reads now
+static size_t playing_count;         // Entries of playing
+static const uint16_t *queued;       // Next table, NULL for none
+static size_t queued_count;          // Entries of queued
+static const uint16_t *finished[2];  // Tables waiting for the callback, oldest first
+static size_t nfinished;             // Entries of finished in use
+static bool wave_loop;               // Play the same table again when nothing is queued
+static wave_done_t wave_done;
+static void *wave_arg;
+
+static void wave_work_fn(void *arg);
+static work_t wave_work = WORK_INIT(wave_work_fn, NULL);
+
+// Bottom half: give the finished tables back, oldest first
+static void wave_work_fn(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint32_t primask = __get_PRIMASK();
+        __disable_irq();
+        const uint16_t *table = nfinished > 0 ? finished[0] : NULL;
+        if (nfinished > 1) finished[0] = finished[1];
+        if (nfinished > 0) nfinished--;
+        __set_PRIMASK(primask);
+        if (table == NULL) return;
+        if (wave_done != NULL) wave_done(table, wave_arg);
+    }
+}
+
+/*
+    Point DMA_CH_WAVE at a table. A request raised meanwhile stays pending
+    with TOF set and is served as soon as ERQ is back.
+    CS: one 16-bit transfer per overflow, SINC: source increment, D_REQ: stop at the end
+*/
+static void wave_arm(const uint16_t *table, size_t count) {
+    playing = table;
+    playing_count = count;
+    dma_arm(DMA_CH_WAVE, table, wave_reg, (uint32_t)(count * sizeof(*table)),
+            DMA_DCR_ERQ_MASK | DMA_DCR_CS_MASK | DMA_DCR_D_REQ_MASK | DMA_DCR_SINC_MASK | DMA_DCR_SSIZE(DMA_SIZE_16) |
+                DMA_DCR_DSIZE(DMA_SIZE_16));
+}
+
+// Both buffers of a stream can finish before the work runs, a third table is not handed back
+static void wave_hand_over(const uint16_t *table) {
+    if (nfinished == sizeof(finished) / sizeof(finished[0])) {
+        wave_stats.underruns++;
+        return;
+    }
+    finished[nfinished++] = table;
+    work_post(&wave_work);
+}
+
+// Called from DMA3_IRQHandler: a table is done
+void wave_irq(void) {
+    uint32_t dsr = DMA0->DMA[DMA_CH_WAVE].DSR_BCR;
+    const uint16_t *done = playing;
+    if (dsr & (DMA_DSR_BCR_CE_MASK | DMA_DSR_BCR_BES_MASK | DMA_DSR_BCR_BED_MASK)) {
+        wave_stats.errors++;
+        wave_arm(done, playing_count);  // Play the table over
+        return;
+    }
+    wave_stats.tables++;
+    if (queued != NULL) {
+        wave_arm(queued, queued_count);
+        queued = NULL;
+        wave_hand_over(done);
+        return;
+    }
+    wave_stats.underruns++;
+    if (wave_loop) {
+        wave_arm(done, playing_count);
+        return;
+    }
+    wave_stop();
+    wave_hand_over(done);
+}
+
+void wave_start(TPM_Type *tpm, uint8_t target, const uint16_t *table, size_t count, bool loop, wave_done_t done,
+                void *arg) {
+    wave_stop();
+    wave_loop = loop;
+    wave_done = done;
+    wave_arg = arg;
+    nfinished = 0;
+
+    // DMA_CH_WAVE writes one register of tpm on every overflow request, busy for idle until wave_stop
+    wave_reg = target == WAVE_PERIOD ? &tpm->MOD : &tpm->CONTROLS[target].CnV;
+    dma_claim(DMA_CH_WAVE);
+    wave_arm(table, count);
+    dma_connect(DMA_CH_WAVE, (uint8_t)(DMA_SRC_TPM0_OVF + pwm_index(tpm)));
+
+    // Writing back a set TOF clears it, the first entry goes out on the next overflow
+    wave_tpm = tpm;
+    BME_OR(tpm->SC, TPM_SC_DMA_MASK);
+}
+
+// Play table after the current one, false if one is queued already or playback has stopped
+bool wave_queue(const uint16_t *table, size_t count) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();  // wave_irq must see the table and its count together
+    bool ok = wave_tpm != NULL && queued == NULL;
+    if (ok) {
+        queued_count = count;
+        queued = table;
+    }
+    __set_PRIMASK(primask);
+    return ok;
+}
+
+// The outputs keep the last value written, the callback is not called for the table playing
+void wave_stop(void) {
+    if (wave_tpm == NULL) return;  // Not playing
+    BME_AND(wave_tpm->SC, ~TPM_SC_DMA_MASK);
+    dma_stop(DMA_CH_WAVE);
+    queued = NULL;
+    wave_tpm = NULL;
+}
@@ -0,0 +1,32 @@
+#include "work.h"
+
+work_queue_t work_queue;
+
+/*
+    Deferred work runs below the tick: PendSV at the lowest priority, SysTick one level
+    above, so a long work item is preempted by the tick instead of delaying and merging ticks.
+    SysTick_Config sets SysTick to the lowest priority, call this after it.
+*/
+void work_init(void) {
+    NVIC_SetPriority(SysTick_IRQn, (1UL << __NVIC_PRIO_BITS) - 2UL);
+    NVIC_SetPriority(PendSV_IRQn, (1UL << __NVIC_PRIO_BITS) - 1UL);  // Lowest, below every IRQ
+}
+
+// Called from PendSV_Handler: run queued items until the queue is empty
+void work_run(void) {
+    for (;;) {
+        __disable_irq();
+        work_t *w = work_queue.head;
+        if (w == NULL) {
+            __enable_irq();
+            return;
+        }
+        work_queue.head = w->next;
+        if (work_queue.head == NULL) work_queue.tail = NULL;
+        w->queued = false;  // The item may post itself again while it runs
+        __enable_irq();
+
+        w->fn(w->arg);
+        work_queue.runs++;
+    }
+}
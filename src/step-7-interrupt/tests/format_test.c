@@ -0,0 +1,77 @@
+/*
+    Host check of fmt_vprintf against the C library: every case is formatted by both
+    and the outputs must match byte for byte. Run with make test, no target needed.
+    The reference is the host's library (glibc on Linux, libSystem on macOS), not the
+    target's newlib, so only behaviour they all share is checked: no %p, whose output
+    is implementation defined, and no NULL for %s, which glibc prints as (null).
+*/
+#include "format.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct {
+    char buf[256];
+    size_t len;
+} sink_t;
+
+static void sink_putc(char c, void *arg) {
+    sink_t *s = (sink_t *)arg;
+    if (s->len < sizeof(s->buf) - 1) s->buf[s->len++] = c;
+}
+
+static int failures, cases;
+
+__attribute__((format(printf, 2, 3))) static void check(int line, const char *format, ...) {
+    char want[256];
+    sink_t got = {{0}, 0};
+    va_list args, copy;
+    va_start(args, format);
+    va_copy(copy, args);
+    int n = vsnprintf(want, sizeof(want), format, args);
+    size_t cnt = fmt_vprintf(sink_putc, &got, format, copy);
+    va_end(copy);
+    va_end(args);
+    got.buf[got.len] = '\0';
+    cases++;
+    if (strcmp(want, got.buf) != 0 || (size_t)n != cnt) {
+        printf("format_test.c:%d: \"%s\": want \"%s\" (%d), got \"%s\" (%zu)\n", line, format, want, n, got.buf, cnt);
+        failures++;
+    }
+}
+
+#define CHECK(...) check(__LINE__, __VA_ARGS__)
+
+int main(void) {
+    // Integers
+    CHECK("%d %d %d", 0, 42, -42);
+    CHECK("%i %d", INT_MAX, INT_MIN);
+    CHECK("%u %u", 0U, UINT_MAX);
+    CHECK("%x %X %x", 0xdeadbeefU, 0xdeadbeefU, 0U);
+    CHECK("%o %#o %#x %#X", 8U, 8U, 255U, 255U);
+    CHECK("%ld %lu %lx", LONG_MIN, ULONG_MAX, 0x12345678UL);
+    CHECK("%lld %llu %llx", LLONG_MIN, ULLONG_MAX, 0x123456789abcdefULL);
+    CHECK("%hhd %hhu %hd %hu", (signed char)-5, (unsigned char)250, (short)-300, (unsigned short)65000);
+    CHECK("%zu %td %jd", (size_t)1234, (ptrdiff_t)-7, (intmax_t)-99);
+
+    // Width, padding and flags
+    CHECK("[%5d] [%-5d] [%05d] [%+d] [% d]", 42, 42, 42, 42, 42);
+    CHECK("[%05d] [%+05d] [% 05d] [%-+5d]", -42, 42, 42, 42);
+    CHECK("[%8x] [%-8X] [%08x] [%#08x]", 0xbeefU, 0xbeefU, 0xbeefU, 0xbeefU);
+    CHECK("[%*d] [%-*d] [%*d]", 6, 7, 6, 7, -6, 7);
+    CHECK("[%10llu] [%-20lld] [%020llu]", 123ULL, -123LL, ULLONG_MAX);
+    CHECK("UART RD: %d, tick: %lu\r\n", 1, 4294967295UL);
+
+    // Precision
+    CHECK("[%.3d] [%.0d] [%5.3d] [%-5.3d]", 7, 0, 7, 7);
+    CHECK("[%.*d] [%.8x] [%#.3o]", 4, 12, 0xabcU, 8U);
+
+    // Characters and strings
+    CHECK("[%c] [%3c] [%-3c]", 'a', 'b', 'c');
+    CHECK("[%s] [%8s] [%-8s] [%.2s] [%*.*s]", "abc", "abc", "abc", "abc", 6, 1, "abc");
+    CHECK("100%% [%s]", "");
+
+    printf("format_test: %d of %d cases differ from vsnprintf\n", failures, cases);
+    return failures != 0;
+}